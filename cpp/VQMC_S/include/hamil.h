@@ -2,11 +2,28 @@
 #ifndef  OPERATORS_H
 #include "./operators/operators.h"
 #endif // ! BINARY_H
+#ifndef TERMS_H
+#include "./operators/terms.h"
+#endif // !TERMS_H
+#ifndef SYMMETRIES_H
+#include "./operators/symmetries.h"
+#endif // !SYMMETRIES_H
+#ifndef ENTANGLEMENT_H
+#include "./operators/entanglement.h"
+#endif // !ENTANGLEMENT_H
 
 #ifndef HAMIL_H
 #define HAMIL_H
 
 using namespace std;
+constexpr u64 ham_build_chunks = 1024;																				// number of basis chunks building the Hamiltonian in parallel
+
+/*
+* @brief caller owned buffer of the (state, value) pairs of the local energy - one per thread or Markov chain
+*/
+template <typename _type>
+using locEnWorkspace = v_1d<std::pair<u64, _type>>;
+
 template <typename _type>
 class SpinHamiltonian {
 public:
@@ -17,6 +34,8 @@ public:
 	Mat<_type> eigenvectors;																							// matrix of the eigenvectors in increasing order
 	vec eigenvalues;																									// eigenvalues vector
 	u64 E_av_idx = -1;																									// average energy
+	bool lanczos_converged = false;																						// did the last matrix-free Lanczos converge
+	double lanczos_residual = 0.0;																						// largest residual of its lowest Ritz pairs
 
 	u64 loc_states_num;																									// local energy states number
 	u64 N;																												// the Hilbert space size
@@ -29,8 +48,10 @@ public:
 	v_1d<u64> mapping;																									// mapping for the reduced Hilbert space
 	v_1d<cpx> normalisation;																							// used for normalization in the symmetry case
 	v_1d<pair<u64, _type>> locEnergies;																				// local energies map
+	hamilTerms<_type> terms;																							// compiled terms of the model
+	spinSymmetries sym;																									// symmetries of the reduced Hilbert space
+	magnetizationSector mag;																							// fixed number of the up spins
 
-	virtual u64 map(u64 index) = 0;																	// function returning either the mapping(symmetries) or the input index (no-symmetry: 1to1 correspondance)
 	// virtual ~SpinHamiltonian() = 0;																	// pure virtual destructor
 	
 	// ------------------------------------------- 				  PRINTERS 				  -------------------------------------------
@@ -78,21 +99,33 @@ public:
 	auto get_hamiltonian()											const RETURNS(this->H);								// get the const reference to a Hamiltonian
 	auto get_eigenvectors()											const RETURNS(this->eigenvectors);					// get the const reference to the eigenvectors
 	auto get_eigenvalues()											const RETURNS(this->eigenvalues);					// get the const reference to eigenvalues
+	auto get_lanczos_converged()									const RETURNS(this->lanczos_converged);				// convergence of the last matrix-free Lanczos
+	auto get_lanczos_residual()										const RETURNS(this->lanczos_residual);				// residual of the last matrix-free Lanczos
+	locEnWorkspace<_type> get_loc_en_workspace() const { return locEnWorkspace<_type>(this->loc_states_num, std::make_pair(LLONG_MAX, _type(0.0))); };	// creates an empty buffer for the local energy
 	auto get_loc_state_at(int i)									const RETURNS(this->locEnergies[i]);				// gets the local energy at given position i
 	auto get_eigenEnergy(u64 idx)									const RETURNS(this->eigenvalues(idx));				// get eigenenergy at a given idx
 	auto get_eigenState(u64 idx)									const RETURNS(this->eigenvectors.col(idx));			// get an eigenstate at a given idx
 	auto get_eigenStateValue(u64 idx, u64 elem)						const RETURNS(this->eigenvectors(elem, idx));		// get an eigenstate at a given idx
+	Col<_type> get_full_state(u64 idx) const;																			// eigenstate at a given idx in the full basis
 	auto get_info(const v_1d<string>& skip = {}, string sep = "_")	const RETURNS(this->inf("", skip, sep));			// get the info about the model
 
 	// ------------------------------------------- 				   GENERAL METHODS  				  -------------------------------------------
-	virtual void hamiltonian() = 0;																						// pure virtual Hamiltonian creator
-	virtual void locEnergy(u64 _id) = 0;																				// returns the local energy for VQMC purposes
-	virtual void locEnergy(const vec& v) = 0;																			// returns the local energy for VQMC purposes
-	virtual void setHamiltonianElem(u64 k, _type value, u64 new_idx) = 0;												// sets the Hamiltonian elements in a virtual way
+	virtual void build_terms(hamilTerms<_type>& t) const = 0;															// adds the terms of the model to the table
+	void compile_terms();																								// compiles the terms table and sets the local energy size
+	void check_symmetries(const spinSymmetries& sym) const;																// throws if the sector cannot be used for the model
+	void set_symmetries(const spinSymmetries& sym);																		// restricts the ED to the symmetry sector
+	void set_magnetization(int n_up);																					// restricts the ED to the fixed number of the up spins
+	u64 get_ed_dim()												const { return this->mag.empty() ? this->N : this->mag.size(); };	// dimension of the ED basis without the lattice symmetries
+	virtual void hamiltonian();																							// Hamiltonian creator from the terms table
+	virtual void locEnergy(u64 _id, locEnWorkspace<_type>& ws) const;													// local energy written to a caller owned buffer - thread safe
+	void locEnergy(u64 _id) { this->locEnergy(_id, this->locEnergies); };												// returns the local energy for VQMC purposes
+	void locEnergy(const vec& v) { this->locEnergy(BASE_TO_INT(v)); };													// returns the local energy for VQMC purposes
 	void diag_h(bool withoutEigenVec = false);																			// diagonalize the Hamiltonian
 	void diag_h(bool withoutEigenVec, uint k, uint subdim = 0, uint maxiter = 1000,\
 		double tol = 0, std::string form = "lm");																		// diagonalize the Hamiltonian using Lanczos' method
 	void diag_h(bool withoutEigenVec, int k, _type sigma);																// diagonalize the Hamiltonian using shift and inverse
+	void apply_h(const Col<_type>& x, Col<_type>& y) const;																// y = H x without forming the Hamiltonian
+	void diag_h_lanczos(uint k, uint maxiter = 500, double tol = 1e-6, bool withEigenVec = false, bool reorth = false);	// matrix-free Lanczos for the lowest eigenvalues
 
 
 	void set_loc_en_elem(int i, u64 state, _type value) { this->locEnergies[i] = std::make_pair(state, value); };		// sets given element of local energies to state, value pair
@@ -179,6 +212,233 @@ inline void SpinHamiltonian<_type>::print_state_pretty(const Col<_type>& state,
 
 // ------------------------------------------------------------  				    HAMILTONIAN  				    ------------------------------------------------------------
 
+/*
+* @brief builds the terms of the model into a flat table, the local energy has a single entry per flip mask
+* and the diagonal one at the very end
+*/
+template <typename _type>
+inline void SpinHamiltonian<_type>::compile_terms()
+{
+	hamilTerms<_type> t(this->Ns);
+	this->build_terms(t);
+	t.compile();
+	this->terms = std::move(t);
+	this->loc_states_num = this->terms.get_off_num() + 1;
+	this->locEnergies = this->get_loc_en_workspace();
+}
+
+/*
+* @brief Checks that the terms are invariant under every element of the group and that the characters of the sector
+* fit the type of the Hamiltonian. Cheap, so it is called before the simulation to reject the sector early.
+* @param sym symmetry group with the characters of the sector
+*/
+template <typename _type>
+inline void SpinHamiltonian<_type>::check_symmetries(const spinSymmetries& sym) const
+{
+	for (size_t g = 0; g < sym.size(); g++) {
+		if (!this->terms.invariant([&](u64 mask) { return sym.permute(g, mask); }, sym.get_inversion(g)))
+			throw "The Hamiltonian is not invariant under the chosen symmetries\n";
+		if constexpr (!std::is_same_v<_type, cpx>)
+			if (std::abs(std::imag(sym.get_char(g))) > 1e-10)
+				throw "Complex characters of the symmetry sector need a complex Hamiltonian\n";
+	}
+}
+
+/*
+* @brief Restricts the exact diagonalization to a symmetry sector. The representatives belonging to the sector are
+* found in parallel and stored in the mapping with their normalisations. Throws if the terms are not invariant.
+* @param sym symmetry group with the characters of the sector, the empty group restores the full basis
+*/
+template <typename _type>
+inline void SpinHamiltonian<_type>::set_symmetries(const spinSymmetries& sym)
+{
+	this->mapping.clear();
+	this->normalisation.clear();
+	this->sym = sym;
+	if (sym.empty())
+		return;
+	if (!this->mag.empty())
+		throw "The lattice symmetries cannot be combined with the fixed magnetization sector\n";
+	this->check_symmetries(sym);
+
+	// representatives found by the chunks, kept in the increasing order
+	const u64 n_chunks = std::min(this->N, ham_build_chunks);
+	v_1d<v_1d<u64>> reps(n_chunks);
+	v_1d<v_1d<cpx>> norms(n_chunks);
+#pragma omp parallel for schedule(dynamic)
+	for (long long c = 0; c < static_cast<long long>(n_chunks); c++) {
+		for (u64 k = c * this->N / n_chunks; k < (c + 1) * this->N / n_chunks; k++) {
+			if (sym.representative(k).first != k)
+				continue;
+			if (const double n = sym.norm(k); n > 0) {
+				reps[c].push_back(k);
+				norms[c].push_back(n);
+			}
+		}
+	}
+	for (u64 c = 0; c < n_chunks; c++) {
+		this->mapping.insert(this->mapping.end(), reps[c].begin(), reps[c].end());
+		this->normalisation.insert(this->normalisation.end(), norms[c].begin(), norms[c].end());
+	}
+}
+
+/*
+* @brief Restricts the exact diagonalization and the matrix-free Lanczos to the states with n_up spins up, which are
+* indexed by their combinatorial rank. Throws if the terms do not conserve the magnetization.
+* @param n_up number of the up spins, negative restores the full basis
+*/
+template <typename _type>
+inline void SpinHamiltonian<_type>::set_magnetization(int n_up)
+{
+	if (n_up < 0) {
+		this->mag = magnetizationSector();
+		return;
+	}
+	if (!this->mapping.empty())
+		throw "The fixed magnetization sector cannot be combined with the lattice symmetries\n";
+	if (!this->terms.conserves_magnetization())
+		throw "The Hamiltonian does not conserve the magnetization\n";
+	this->mag = magnetizationSector(this->Ns, n_up);
+}
+
+/*
+* @brief Eigenstate in the full basis. In a symmetry sector |psi> = sum_r psi_r / n_r sum_g chi(g)^* g|r>.
+* @param idx index of the eigenstate
+*/
+template <typename _type>
+inline Col<_type> SpinHamiltonian<_type>::get_full_state(u64 idx) const
+{
+	if (this->mapping.empty() && this->mag.empty())
+		return this->eigenvectors.col(idx);
+	Col<_type> psi(this->N, arma::fill::zeros);
+	if (!this->mag.empty()) {
+		for (u64 k = 0, state = this->mag.state(0); k < this->mag.size(); k++, state = this->mag.next(state))
+			psi(state) = this->eigenvectors(k, idx);
+		return psi;
+	}
+	for (u64 k = 0; k < this->mapping.size(); k++) {
+		for (size_t g = 0; g < this->sym.size(); g++) {
+			const cpx coeff = std::conj(this->sym.get_char(g)) / this->normalisation[k];
+			if constexpr (std::is_same_v<_type, cpx>)
+				psi(this->sym.apply(g, this->mapping[k])) += coeff * this->eigenvectors(k, idx);
+			else
+				psi(this->sym.apply(g, this->mapping[k])) += std::real(coeff) * this->eigenvectors(k, idx);
+		}
+	}
+	return psi;
+}
+
+/*
+* @brief Calculate the local energy from the terms table. The values are <s|H|s'> = <s'|H|s>^*.
+* @param _id base state index
+* @param ws caller owned buffer for the (state, value) pairs - does not touch the model, so it is thread safe
+*/
+template <typename _type>
+inline void SpinHamiltonian<_type>::locEnergy(u64 _id, locEnWorkspace<_type>& ws) const
+{
+	const auto off_num = this->terms.get_off_num();
+	// the terms may have been recompiled since the buffer was created
+	ws.resize(off_num + 1);
+	for (size_t g = 0; g < off_num; g++) {
+		_type val = this->terms.off_diagonal(g, _id);
+		if constexpr (std::is_same_v<_type, cpx>)
+			val = std::conj(val);
+		// the entries that are not hit stay unset
+		ws[g] = val == _type(0.0) ? std::make_pair(u64(LLONG_MAX), _type(0.0)) : std::make_pair(_id ^ this->terms.get_flip(g), val);
+	}
+	// append unchanged at the very end
+	ws[off_num] = std::make_pair(_id, this->terms.diagonal(_id));
+}
+
+/*
+* @brief Generates the total Hamiltonian of the system from the terms table. The basis is split into chunks that
+* collect their own (row, col, value) triplets in parallel and the sparse matrix is assembled once with
+* the batch insertion constructor, instead of the slow element by element insertion.
+* With the symmetries set, only the block of the sector in the basis of the representatives is built: the state
+* s' = g r' connected to the representative r adds <r'|H|r> += <s'|H|r> chi(g) n_r' / n_r.
+* In the fixed magnetization sector the chunk walks its states in the increasing order and the connected states
+* are indexed by their rank.
+*/
+template <typename _type>
+inline void SpinHamiltonian<_type>::hamiltonian()
+{
+	const auto off_num = this->terms.get_off_num();
+	const bool reduced = !this->mapping.empty();
+	const bool fixed_mag = !this->mag.empty();
+	const u64 dim = reduced ? this->mapping.size() : this->get_ed_dim();
+	const u64 n_chunks = std::min(dim, ham_build_chunks);
+	v_1d<v_1d<arma::uword>> rows(n_chunks);
+	v_1d<v_1d<arma::uword>> cols(n_chunks);
+	v_1d<v_1d<_type>> vals(n_chunks);
+	//  hamiltonian memory reservation
+	try {
+#pragma omp parallel for schedule(dynamic)
+		for (long long c = 0; c < static_cast<long long>(n_chunks); c++) {
+			const u64 start = c * dim / n_chunks;
+			const u64 end = (c + 1) * dim / n_chunks;
+			rows[c].reserve((end - start) * (off_num + 1));
+			cols[c].reserve((end - start) * (off_num + 1));
+			vals[c].reserve((end - start) * (off_num + 1));
+			u64 state = fixed_mag ? this->mag.state(start) : start;
+			for (u64 k = start; k < end; k++) {
+				if (fixed_mag)	state = k == start ? state : this->mag.next(state);
+				else			state = reduced ? this->mapping[k] : k;
+				if (const _type val = this->terms.diagonal(state); val != _type(0.0)) {
+					rows[c].push_back(k);
+					cols[c].push_back(k);
+					vals[c].push_back(val);
+				}
+				for (size_t g = 0; g < off_num; g++) {
+					_type val = this->terms.off_diagonal(g, state);
+					if (val == _type(0.0))
+						continue;
+					u64 new_idx = state ^ this->terms.get_flip(g);
+					if (reduced) {
+						const auto [rep, chi] = this->sym.representative(new_idx);
+						const auto it = std::lower_bound(this->mapping.begin(), this->mapping.end(), rep);
+						// the representative does not belong to the sector
+						if (it == this->mapping.end() || *it != rep)
+							continue;
+						new_idx = it - this->mapping.begin();
+						const cpx factor = chi * this->normalisation[new_idx] / this->normalisation[k];
+						if constexpr (std::is_same_v<_type, cpx>)
+							val *= factor;
+						else
+							val *= std::real(factor);
+					}
+					else if (fixed_mag)
+						new_idx = this->mag.rank(new_idx);
+					rows[c].push_back(new_idx);
+					cols[c].push_back(k);
+					vals[c].push_back(val);
+				}
+			}
+		}
+		// assemble the triplets of all chunks
+		size_t nnz = 0;
+		for (const auto& v : vals)
+			nnz += v.size();
+		arma::umat locations(2, nnz);
+		Col<_type> values(nnz);
+		size_t pos = 0;
+		for (u64 c = 0; c < n_chunks; c++) {
+			for (size_t i = 0; i < vals[c].size(); i++, pos++) {
+				locations(0, pos) = rows[c][i];
+				locations(1, pos) = cols[c][i];
+				values(pos) = vals[c][i];
+			}
+			v_1d<arma::uword>().swap(rows[c]);
+			v_1d<arma::uword>().swap(cols[c]);
+			v_1d<_type>().swap(vals[c]);
+		}
+		this->H = SpMat<_type>(true, locations, values, dim, dim);
+	}
+	catch (const std::bad_alloc& e) {
+		std::cout << "Memory exceeded" << e.what() << "\n";
+		assert(false);
+	}
+}
+
 /*
 * @brief General procedure to diagonalize the Hamiltonian using eig_sym from the Armadillo library
 * @param withoutEigenVec doesnot compute eigenvectors to save memory potentially
@@ -196,7 +456,7 @@ void SpinHamiltonian<T>::diag_h(bool withoutEigenVec) {
 	}
 
 	// calculates the middle spectrum element
-	double E_av = trace(eigenvalues) / double(N);
+	double E_av = trace(eigenvalues) / double(eigenvalues.n_elem);
 	auto i = std::ranges::min_element(std::begin(eigenvalues), std::end(eigenvalues), [=](int x, int y) {
 		return abs(x - E_av) < abs(y - E_av);
 		});
@@ -244,12 +504,147 @@ void SpinHamiltonian<_type>::diag_h(bool withoutEigenVec, int k, _type sigma) {
 }
 
 
+/*
+* @brief Applies the Hamiltonian to a vector on the fly from the terms table, in parallel over the basis states.
+* Each row is gathered as y(s) = <s|H|s> x(s) + sum_X <s|H|s^X> x(s^X), so the threads never write to the same element.
+* In the fixed magnetization sector the vectors are indexed by the rank of the states.
+* @param x vector to be multiplied
+* @param y H x
+*/
+template <typename _type>
+inline void SpinHamiltonian<_type>::apply_h(const Col<_type>& x, Col<_type>& y) const
+{
+	const auto off_num = this->terms.get_off_num();
+	const bool fixed_mag = !this->mag.empty();
+	const u64 dim = this->get_ed_dim();
+	y.set_size(dim);
+#pragma omp parallel for
+	for (long long k = 0; k < static_cast<long long>(dim); k++) {
+		const u64 state = fixed_mag ? this->mag.state(k) : k;
+		_type val = this->terms.diagonal(state) * x(k);
+		for (size_t g = 0; g < off_num; g++) {
+			// <s|H|s^X> = <s^X|H|s>^*
+			_type elem = this->terms.off_diagonal(g, state);
+			if (elem == _type(0.0))
+				continue;
+			if constexpr (std::is_same_v<_type, cpx>)
+				elem = std::conj(elem);
+			const u64 new_state = state ^ this->terms.get_flip(g);
+			val += elem * x(fixed_mag ? this->mag.rank(new_state) : new_state);
+		}
+		y(k) = val;
+	}
+}
+
+/*
+* @brief Matrix-free Lanczos method for the lowest eigenvalues. The Hamiltonian is applied with apply_h, so only
+* a few vectors of the Hilbert space size are kept: without the reorthogonalization the three-term recurrence needs
+* the current and the previous Lanczos vectors, and the ground state is obtained in a second pass from the same
+* starting vector. The higher Ritz values of such a run may contain spurious copies of the converged ones, therefore
+* the full reorthogonalization, which stores the whole Krylov basis, is always used for more than one eigenvalue.
+* @param k number of the lowest eigenvalues
+* @param maxiter maximal dimension of the Krylov space
+* @param tol relative residual |beta_m y_m| of the lowest Ritz pairs, the error of a Ritz value is of the order of
+* the squared residual over the gap. The outcome is kept in lanczos_converged
+* @param withEigenVec compute the ground state as the first column of the eigenvectors
+* @param reorth full reorthogonalization against the stored Krylov basis, forced for k > 1
+*/
+template <typename _type>
+inline void SpinHamiltonian<_type>::diag_h_lanczos(uint k, uint maxiter, double tol, bool withEigenVec, bool reorth)
+{
+	if (!this->mapping.empty())
+		throw "The matrix-free Lanczos works in the full basis only\n";
+	reorth = reorth || k > 1;
+	const u64 dim = this->get_ed_dim();
+	maxiter = std::max<uint>(std::min<u64>(maxiter, dim), 1);
+	Col<_type> v(dim, arma::fill::randu), v_prev(dim, arma::fill::zeros), w;
+	v /= arma::norm(v);
+	// the starting vector is needed again only for the second pass
+	Col<_type> v0;
+	if (withEigenVec && !reorth)
+		v0 = v;
+	Mat<_type> Q;
+	if (reorth)
+		Q = Mat<_type>(dim, maxiter);
+
+	v_1d<double> alphas, betas;
+	vec ritz;
+	mat ritz_vecs;
+	this->lanczos_converged = false;
+	auto tridiagonal = [&]() {
+		const auto m = alphas.size();
+		mat T(m, m, arma::fill::zeros);
+		for (auto j = 0; j < m; j++) {
+			T(j, j) = alphas[j];
+			if (j + 1 < m) T(j, j + 1) = T(j + 1, j) = betas[j];
+		}
+		return T;
+	};
+	for (uint j = 0; j < maxiter; j++) {
+		if (reorth) Q.col(j) = v;
+		this->apply_h(v, w);
+		const double alpha = std::real(arma::cdot(v, w));
+		w -= alpha * v;
+		if (j > 0) w -= betas.back() * v_prev;
+		if (reorth)
+			for (uint i = 0; i <= j; i++)
+				w -= Q.col(i) * arma::cdot(Q.col(i), w);
+		alphas.push_back(alpha);
+
+		const double beta = arma::norm(w);
+		const bool invariant = beta < 1e-14;
+		// check the residuals of the lowest Ritz pairs, ||H x - theta x|| = beta |y_m|
+		if (invariant || j + 1 == maxiter || (j + 1) % 5 == 0) {
+			arma::eig_sym(ritz, ritz_vecs, tridiagonal());
+			const auto n = std::min<size_t>(k, ritz.n_elem);
+			this->lanczos_residual = 0.0;
+			bool converged = n == k;
+			for (auto i = 0; i < n; i++) {
+				const double res = beta * std::abs(ritz_vecs(j, i));
+				this->lanczos_residual = std::max(this->lanczos_residual, res);
+				converged = converged && res < tol * std::max(1.0, std::abs(ritz(i)));
+			}
+			this->lanczos_converged = invariant || converged;
+			if (this->lanczos_converged || j + 1 == maxiter)
+				break;
+		}
+		betas.push_back(beta);
+		v_prev = v;
+		v = w / beta;
+	}
+	const auto m = alphas.size();
+	this->eigenvalues = ritz.head(std::min<size_t>(k, ritz.n_elem));
+
+	if (!withEigenVec)
+		return;
+	// ground state from the Ritz vector
+	const vec y = ritz_vecs.col(0);
+	Col<_type> ground(dim, arma::fill::zeros);
+	if (reorth)
+		ground = Q.cols(0, m - 1) * arma::conv_to<Col<_type>>::from(y);
+	else {
+		// repeat the recurrence from the same starting vector
+		v = v0;
+		v_prev.zeros();
+		for (auto j = 0; j < m; j++) {
+			ground += y(j) * v;
+			if (j + 1 == m) break;
+			this->apply_h(v, w);
+			w -= alphas[j] * v;
+			if (j > 0) w -= betas[j - 1] * v_prev;
+			v_prev = v;
+			v = w / betas[j];
+		}
+	}
+	this->eigenvectors = Mat<_type>(ground / arma::norm(ground));
+}
+
 // ------------------------------------------------------------  				    ENTROPY   				   ------------------------------------------------------------
 
 
 
 /*
-*  @brief Calculates the reduced density matrix of the system via the mixed density matrix
+*  @brief Calculates the reduced density matrix of the eigenstate reshaped into the dimB x dimA matrix
 *  @param state state to produce the density matrix
 *  @param A_size size of subsystem
 *  @returns reduced density matrix
@@ -257,65 +652,32 @@ void SpinHamiltonian<_type>::diag_h(bool withoutEigenVec, int k, _type sigma) {
 template<typename _type>
 inline Mat<_type> SpinHamiltonian<_type>::red_dens_mat(u64 state, int A_size) const
 {
-	const auto Ns = this->lattice->get_Ns();
-	// set subsytsems size
-	const u64 dimA = ULLPOW(A_size);
-	const u64 dimB = ULLPOW(Ns - A_size);
-
-	Mat<_type> rho(dimA, dimA, arma::fill::zeros);
-	// loop over configurational basis
-	for (auto n = 0; n < this->N; n++) {
-		u64 counter = 0;
-		// pick out state with same B side (last L-A_size bits)
-		for (u64 m = n % dimB; m < N; m += dimB) {
-			// find index of state with same B-side (by dividing the last bits are discarded)
-			u64 idx = n / dimB;
-			rho(idx, counter) += conj(this->get_eigenStateValue(state, n)) * this->get_eigenStateValue(state, m);
-			// increase counter to move along reduced basis
-			counter++;
-		}
-	}
-	return rho;
+	return entanglement::red_dens_mat(this->get_full_state(state), this->Ns, A_size);
 }
 
 
 /*
-*  @brief Calculates the entropy of the system via the mixed density matrix
+*  @brief Calculates the entropy of the eigenstate from the squared Schmidt values
 *  @param state state index to produce the density matrix
 *  @param A_size size of subsystem
 *  @returns entropy of considered systsem
 */
 template<typename _type>
 inline double SpinHamiltonian<_type>::entanglement_entropy(u64 state, int A_size) const {
-	auto rho = red_dens_mat(state, A_size);
-	vec probabilities;
-	// diagonalize to find probabilities and calculate trace in rho's eigenbasis
-	eig_sym(probabilities, rho);
-
-	double entropy = 0;
-	//#pragma omp parallel for reduction(+: entropy)
-	for (auto i = 0; i < probabilities.size(); i++) {
-		const auto value = probabilities(i);
-		entropy += (abs(value) < 1e-10) ? 0 : -value * log(abs(value));
-	}
-	//double entropy = -real(trace(rho * real(logmat(rho))));
-	return entropy;
+	return entanglement::renyi(entanglement::schmidt_spectrum(this->get_full_state(state), this->Ns, A_size), 1.0);
 }
 
 
 /*
-* @brief Calculates the entropy of the system via the mixed density matrix
+* @brief Calculates the entropy of the eigenstate for all the bond cuts in parallel, the state is expanded to the full
+* basis only once
 * @param state state index to produce the density matrix
 * @returns entropy of considered systsem for different subsystem sizes
 */
 template<typename _type>
 inline vec SpinHamiltonian<_type>::entanglement_entropy_sweep(u64 state) const
 {
-	vec entropy(this->Ns - 1, arma::fill::zeros);
-#pragma omp parallel for
-	for (int i = 0; i < this->Ns - 1; i++)
-		entropy(i) = entanglement_entropy(state, i + 1);
-	return entropy;
+	return entanglement::sweep(this->get_full_state(state), this->Ns).col(0);
 }
 
 
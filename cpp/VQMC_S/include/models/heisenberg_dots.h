@@ -20,13 +20,6 @@ private:
 	vec cos_phis;										// parametrized angles of the classical spins [0,2pi] - xy plane - cosinuses
 	vec sin_phis;										// parametrized angles of the classical spins [0,2pi] - xy plane - sinuses
 
-	vec tmp_vec;
-	vec tmp_vec2;
-
-	tuple<u64, double> sx_int;							// tuple to store the value of sx local interaction (after flip)
-	tuple<u64, _type> sy_int;							// tuple to store the value of sy local interaction (after flip)
-	tuple<u64, double> sz_int;							// tuple to store the value of sz local interaction (no flip)
-
 public:
 	~Heisenberg_dots() = default;
 	Heisenberg_dots() = default;
@@ -37,13 +30,10 @@ public:
 	void set_angles(const vec& phis, const vec& thetas);
 
 	// -----------------------------------				 GETTERS 				 ---------------------------------
-	void get_dot_interaction(u64 state, int position_elem);
-	tuple<double, _type, double> get_dot_int_return(double si, int position_elem);
+	tuple<double, _type, double> get_dot_int_return(double si, int position_elem) const;
 
 	// ----------------------------------- 				 OTHER STUFF 				 ---------------------------------
-	void locEnergy(u64 _id) override;
-	void locEnergy(const vec& v) override;
-	void hamiltonian() override;
+	void build_terms(hamilTerms<_type>& t) const override;
 
 	string inf(const v_1d<string>& skip = {}, string sep = "_") const override
 	{
@@ -64,7 +54,7 @@ public:
 // ----------------------------------------------------------------------------- CONSTRUCTORS -----------------------------------------------------------------------------
 template<typename _type>
 inline Heisenberg_dots<_type>::Heisenberg_dots(double J, double J0, double g, double g0, double h, double w, double delta, std::shared_ptr<Lattice> lat, const v_1d<int>& positions, const vec& J_dot, double J_dot0)
-	: Heisenberg<_type>(J, J0, g, g0, h, w, delta, lat)
+	: Heisenberg<_type>(J, J0, g, g0, h, w, delta, lat, false)
 {
 	this->positions = positions;
 	// sort the postitions vector for building block convinience
@@ -76,7 +66,7 @@ inline Heisenberg_dots<_type>::Heisenberg_dots(double J, double J0, double g, do
 	// creates random disorder vector
 	this->J_dots = create_random_vec(dot_num, this->ran, this->J_dot0);
 
-	// reserve memory
+	// reserve memory and compile the terms
 	this->set_angles();
 
 	// set info
@@ -100,6 +90,8 @@ inline void Heisenberg_dots<_type>::set_angles()
 	this->sin_thetas = sin(thetas);
 	this->cos_phis = cos(phis);
 	this->sin_phis = sin(phis);
+	// the dot couplings depend on the angles
+	this->compile_terms();
 }
 /*
 * @brief sets the angles
@@ -129,6 +121,8 @@ inline void Heisenberg_dots<_type>::set_angles(const vec& phis, const vec& theta
 	this->sin_thetas = sin(a_thetas);
 	this->cos_phis = cos(a_phis);
 	this->sin_phis = sin(a_phis);
+	// the dot couplings depend on the angles
+	this->compile_terms();
 }
 
 // ----------------------------------------------------------------------------- DOT INTERACTION -----------------------------------------------------------------------------
@@ -139,7 +133,7 @@ inline void Heisenberg_dots<_type>::set_angles(const vec& phis, const vec& theta
 * @param position_elem - element of possitions in dots
 */
 template<typename _type>
-inline tuple<double, _type, double> Heisenberg_dots<_type>::get_dot_int_return(double si, int position_elem)
+inline tuple<double, _type, double> Heisenberg_dots<_type>::get_dot_int_return(double si, int position_elem) const
 {
 	const auto position = this->positions[position_elem];
 	double s_z_int = 0.0;
@@ -170,7 +164,7 @@ inline tuple<double, _type, double> Heisenberg_dots<_type>::get_dot_int_return(d
 * @param position_elem element of possitions in dots
 */
 template<>
-inline tuple<double, double, double> Heisenberg_dots<double>::get_dot_int_return(double si, int position_elem)
+inline tuple<double, double, double> Heisenberg_dots<double>::get_dot_int_return(double si, int position_elem) const
 {
 	const auto position = this->positions[position_elem];
 	double s_z_int = 0.0;
@@ -192,218 +186,30 @@ inline tuple<double, double, double> Heisenberg_dots<double>::get_dot_int_return
 	return std::make_tuple(s_x_int, s_y_int, s_z_int);
 }
 
-/*
-* @brief Gets the interaction with the dots at the given position_elem from positions vector
-* @param state current state on which the flip is done
-* @param position_elem element of possitions in dots
-*/
-template<typename _type>
-inline void Heisenberg_dots<_type>::get_dot_interaction(u64 state, int position_elem)
-{
-	const auto position = this->positions[position_elem];
-	// check the position at elem site as if the dot would be on top of the site (left nei)
-	if (position >= 0 && position < this->Ns) {
-		double si = checkBit(state, this->Ns - 1 - position) ? 1.0 : -1.0;
-
-		// set the s_z element
-		auto Jz = (this->J_dots(2) + this->J_dot(2));
-		sz_int = make_tuple(state, Jz * si * this->cos_thetas[position_elem]);
-
-		// flip the state 
-		u64 new_state = flip(state, this->Ns - 1 - position);
-
-		auto Jy = (this->J_dots(1) + this->J_dot(1));
-		// set the s_y element 
-		sy_int = make_tuple(new_state, Jy * imn * si * this->sin_thetas[position_elem] * this->sin_phis[position_elem]);
-
-		auto Jx = (this->J_dots(0) + this->J_dot(0));
-		// set the s_x element 
-		sx_int = make_tuple(new_state, Jx * this->sin_thetas[position_elem] * this->cos_phis[position_elem]);
-	}
-}
-
 // ----------------------------------------------------------- 				 BUILDING HAMILTONIAN 				 -----------------------------------------------------------
 
 /*
-* @brief Generates the total Hamiltonian of the system. The diagonal part is straightforward,
-* while the non-diagonal terms need the specialized setHamiltonainElem(...) function
-*/
-template <typename _type>
-void Heisenberg_dots<_type>::hamiltonian() {
-	try {
-		this->H = SpMat<_type>(this->N, this->N);										//  hamiltonian memory reservation
-	}
-	catch (const std::bad_alloc& e) {
-		std::cout << "Memory exceeded" << e.what() << "\n";
-		assert(false);
-	}
-	// build the Hamiltonian
-	for (auto k = 0; k < this->N; k++) {
-		// interaction with the dot at left site will be held with single variable as position is sorted
-		int dot_iter = 0;
-		for (int j = 0; j < this->Ns; j++) {
-			auto nn_number = this->lattice->get_nn_number(j);
-			// true - spin up, false - spin down
-			double si = checkBit(k, this->Ns - 1 - j) ? 1.0 : -1.0;
-
-			// perpendicular magnetic field
-			this->H(k, k) += (this->h + this->dh(j)) * si;
-
-			// transverse field
-			const u64 new_idx = flip(k, this->Ns - 1 - j);
-			this->setHamiltonianElem(k, this->g + this->dg(j), new_idx);
-
-			// interaction - check if nn exists
-			for (auto n_num = 0; n_num < nn_number; n_num++) {
-				if (const auto nn = this->lattice->get_nn(j, n_num); nn >= 0) {
-					// Ising-like spin correlation // check the bit on the nn
-					double sj = checkBit(k, this->Ns - 1 - nn) ? 1.0 : -1.0;
-					auto interaction = (this->J + this->dJ(j));
-
-					// setting the neighbors elements
-					this->H(k, k) += this->delta * interaction * si * sj;
-
-					// S+S- + S-S+ hopping
-					if (si * sj < 0)
-						this->setHamiltonianElem(k, 0.5 * interaction, flip(new_idx, this->Ns - 1 - nn));
-				}
-			}
-			// handle the dot
-			if (positions[dot_iter] == j) {
-				const auto [s_x_i, s_y_i, s_z_i] = this->get_dot_int_return(si, dot_iter);
-				// set sz_int
-				this->H(k, k) += s_z_i;
-				// set sy_int
-				this->setHamiltonianElem(k, s_y_i, new_idx);
-				// set sx_int 
-				this->setHamiltonianElem(k, s_x_i, new_idx);
-				dot_iter++;
-			}
-		}
-	}
-}
-
-// -----------------------------------------------------------  				 LOCAL ENERGY 				  -----------------------------------------------------------
-
-/*
-* @brief Calculate the local energy end return the corresponding vectors with the value
-* @param _id base state index
+* @brief Adds the terms of the Hamiltonian - the Heisenberg ones and the interaction with the classical spins
+* on top of the sites given by the positions
+* @param t table to be filled
 */
 template <typename _type>
-void Heisenberg_dots<_type>::locEnergy(u64 _id) {
-	// sumup the value of non-changed state
-	double localVal = 0;
-	
-	// cannot use omp because of dot_iter
-	int dot_iter = 0;
-
-	for (auto i = 0; i < this->Ns; i++) {
-		// 
-		auto nn_number = this->lattice->get_nn_number(i);
-		// true - spin up, false - spin down
-		double si = checkBit(_id, this->Ns - i - 1) ? 1.0 : -1.0;								
-
-		// perpendicular field
-		localVal += (this->h + this->dh(i)) * si;
-
-		// transverse field
-		const u64 new_idx = flip(_id, this->Ns - 1 - i);
-		_type s_flipped_en = this->g + this->dg(i);
-
-		// check the Siz Si+1z
-		for (auto n_num = 0; n_num < nn_number; n_num++) {
-			if (auto nei = this->lattice->get_nn(i, n_num); nei >= 0) {
-				double sj = checkBit(_id, this->Ns - 1 - nei) ? 1.0 : -1.0;
-				auto interaction = (this->J + this->dJ(i));
-				// diagonal elements setting  interaction field
-				localVal += this->delta * interaction * si * sj;
-
-				// S+S- + S-S+
-				if (si * sj < 0)
-					this->locEnergies[this->Ns + i] = std::pair{ flip(new_idx, this->Ns - 1 - nei), 0.5 * interaction };
-			}
-		}
-		// handle the dot
-		if (positions[dot_iter] == i) {
-			const auto [s_x_i, s_y_i, s_z_i] = this->get_dot_int_return(si, dot_iter);
-			// set sz_int
-			localVal += s_z_i;
-			// set sy_int and sx_int (REMEMBER TO CONJUGATE AS WE CALCULATE <s|O|s'> not <s'|O|s>)
-			s_flipped_en += -s_y_i + s_z_i;
-			// next position!
-			dot_iter++;
-		}
-		// set the flipped state
-		this->locEnergies[i] = std::pair{ new_idx, s_flipped_en };
-	}
-	// append unchanged at the very end
-	this->locEnergies[2 * this->Ns] = std::pair{ _id, static_cast<_type>(localVal) };
-}
-
-
-/*
-* @brief Calculate the local energy end return the corresponding vectors with the value
-* @param _id base state index
-*/
-template <typename _type>
-void Heisenberg_dots<_type>::locEnergy(const vec& v) {
-	// sumup the value of non-changed state
-	double localVal = 0;
-
-	// cannot use omp because of dot_iter
-	int dot_iter = 0;
-
-	for (auto i = 0; i < this->Ns; i++) {
-		// 
-		auto nn_number = this->lattice->get_nn_number(i);
-		// true - spin up, false - spin down
-		double si = checkBitV(v, i) > 0 ? 1.0 : -1.0;
-
-		// perpendicular field
-		localVal += (this->h + this->dh(i)) * si;
-
-		// transverse field
-		this->tmp_vec = v;
-		flipV(tmp_vec, i);
-		const u64 new_idx = baseToInt(tmp_vec);
-		_type s_flipped_en = this->g + this->dg(i);
-
-		// check the Siz Si+1z
-		for (auto n_num = 0; n_num < nn_number; n_num++) {
-			this->tmp_vec2 = this->tmp_vec;
-			if (auto nn = this->lattice->get_nn(i, n_num); nn >= 0) {
-				// check Sz 
-				double sj = checkBitV(v, nn) > 0 ? 1.0 : -1.0;
-
-				auto interaction = (this->J + this->dJ(i));
-				// diagonal elements setting  interaction field
-				localVal += this->delta * interaction * si * sj;
-
-				// S+S- + S-S+
-				if (si * sj < 0) {
-					flipV(tmp_vec2, nn);
-					auto flip_idx_nn = baseToInt(tmp_vec2);
-					this->locEnergies[this->Ns + i] = std::pair{ flip_idx_nn, 0.5 * interaction };
-				}
-				else
-					this->locEnergies[this->Ns + i] = std::pair{ LONG_MAX, 0 };
-			}
-		}
-		// handle the dot
-		if (positions[dot_iter] == i) {
-			const auto [s_x_i, s_y_i, s_z_i] = this->get_dot_int_return(si, dot_iter);
-			// set sz_int
-			localVal += s_z_i;
-			// set sy_int and sx_int (REMEMBER TO CONJUGATE AS WE CALCULATE <s|O|s'> not <s'|O|s>)
-			s_flipped_en += -s_y_i + s_z_i;
-			// next position!
-			dot_iter++;
-		}
-		// set the flipped state
-		this->locEnergies[i] = std::pair{ new_idx, s_flipped_en };
+void Heisenberg_dots<_type>::build_terms(hamilTerms<_type>& t) const {
+	Heisenberg<_type>::build_terms(t);
+
+	// handle the dots, the couplings are linear in the spin at the position
+	for (int dot_iter = 0; dot_iter < this->dot_num; dot_iter++) {
+		const auto position = this->positions[dot_iter];
+		if (position < 0 || position >= this->Ns)
+			continue;
+		const auto [s_x_i, s_y_i, s_z_i] = this->get_dot_int_return(1.0, dot_iter);
+		// set sz_int
+		t.add_z(position, s_z_i);
+		// set sy_int
+		t.add_off(t.site(position), t.site(position), s_y_i);
+		// set sx_int 
+		t.add_x(position, s_x_i);
 	}
-	// append unchanged at the very end
-	this->locEnergies[2 * this->Ns] = std::pair{ baseToInt(v), static_cast<_type>(localVal) };
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,206 @@
+#pragma once
+#ifndef HAMIL_H
+#include "../hamil.h"
+#endif // !HAMIL_H
+
+#ifndef PAULISTRINGS
+#define PAULISTRINGS
+#include <fstream>
+#include <sstream>
+
+/*
+/// Model given by a list of weighted Pauli strings read from a file. Each string is compiled into the terms table,
+/// so the local energy and the ED Hamiltonian do not need any model specific code. Every Pauli string is Hermitian,
+/// so the coefficients must be real for H to be Hermitian, as the local energy and the ED assume.
+///
+/// Text file - one string per line, # starts a comment:
+///		coefficient P_site P_site ...			e.g.	1.0 Z0 Z1	|	0.5 X0 X1	|	-0.5 Y2
+/// Binary file (.bin extension) - records of:
+///		uint32 number of operators, double real part, double imaginary part (must be 0), [char operator, int32 site] x number
+*/
+template <typename _type>
+class PauliStrings : public SpinHamiltonian<_type> {
+	using pauliString = std::pair<_type, v_1d<std::pair<char, int>>>;
+private:
+	std::string filename;																					// file with the strings
+	v_1d<pauliString> strings;																				// coefficients and the (operator, site) products
+
+	void read_text(std::ifstream& file);
+	void read_binary(std::ifstream& file);
+	void add_string(double c, const v_1d<std::pair<char, int>>& ops, size_t line = 0);
+	[[noreturn]] void fail(const char* msg, size_t line = 0) const;
+public:
+	// ------------------------------------------- 				 Constructors				  -------------------------------------------
+	~PauliStrings() = default;
+	PauliStrings() = default;
+	PauliStrings(const std::string& filename, std::shared_ptr<Lattice> lat);
+
+	// METHODS
+	void build_terms(hamilTerms<_type>& t) const override;													// adds the terms of the model to the table
+	auto get_strings_num()														const RETURNS(this->strings.size());	// number of the strings read
+
+	string inf(const v_1d<string>& skip = {}, string sep = "_") const
+	{
+		auto name_start = this->filename.find_last_of("/\\");
+		auto stem = this->filename.substr(name_start == string::npos ? 0 : name_start + 1);
+		string name = sep + \
+			"pauli,Ns=" + STR(this->Ns) + \
+			",n=" + STR(this->strings.size()) + \
+			",f=" + stem.substr(0, stem.find_last_of('.'));
+		return SpinHamiltonian<_type>::inf(name, skip, sep);
+	}
+};
+
+// ----------------------------------------------------------------------------- CONSTRUCTORS -----------------------------------------------------------------------------
+
+/*
+* @brief Pauli strings constructor
+* @param filename text file or binary file with the .bin extension containing the strings
+* @param lat general lattice class that informs about the number of sites
+*/
+template <typename _type>
+PauliStrings<_type>::PauliStrings(const std::string& filename, std::shared_ptr<Lattice> lat)
+	: filename(filename)
+{
+	this->lattice = lat;
+	this->ran = randomGen();
+	this->Ns = this->lattice->get_Ns();
+	this->N = ULLPOW(this->Ns);																				// Hilber space size
+
+	const bool binary = filename.size() > 4 && filename.substr(filename.size() - 4) == ".bin";
+	std::ifstream file;
+	openFile(file, filename, binary ? std::ios::in | std::ios::binary : std::ios::in);
+	if (binary)	this->read_binary(file);
+	else		this->read_text(file);
+	file.close();
+	this->compile_terms();																					// sets the terms and the local energies vector
+
+	//change info
+	this->info = this->inf();
+}
+
+// ----------------------------------------------------------------------------- READING -----------------------------------------------------------------------------
+
+/*
+* @brief prints the error with the file (and the line) it comes from and throws it
+* @param msg error message
+* @param line line of the text file, 0 if not known
+*/
+template <typename _type>
+inline void PauliStrings<_type>::fail(const char* msg, size_t line) const
+{
+	stout << msg << "\t-> in " + this->filename + (line > 0 ? ", line " + STR(line) : "") << EL;
+	throw msg;
+}
+
+/*
+* @brief checks and stores a single string
+* @param c coefficient
+* @param ops (operator, site) pairs
+* @param line line of the text file, 0 for the binary file
+*/
+template <typename _type>
+inline void PauliStrings<_type>::add_string(double c, const v_1d<std::pair<char, int>>& ops, size_t line)
+{
+	u64 used = 0;
+	for (const auto& [op, site] : ops) {
+		if (op != 'X' && op != 'Y' && op != 'Z')
+			this->fail("Unknown Pauli operator\n", line);
+		if (site < 0 || site >= this->Ns)
+			this->fail("Pauli operator site out of the lattice\n", line);
+		if (checkBit(used, site))
+			this->fail("Pauli string acts twice on the same site\n", line);
+		used |= u64(1) << site;
+	}
+	this->strings.push_back(std::make_pair(_type(c), ops));
+}
+
+/*
+* @brief reads the strings from a text file. Only the blank and the comment lines are skipped, any other line
+* must be a real coefficient followed by the operators of the form P<site>.
+*/
+template <typename _type>
+inline void PauliStrings<_type>::read_text(std::ifstream& file)
+{
+	std::string line;
+	for (size_t line_num = 1; std::getline(file, line); line_num++) {
+		// skip the comments
+		line = line.substr(0, line.find('#'));
+		std::istringstream stream(line);
+		std::string token;
+		if (!(stream >> token))
+			continue;
+		// the coefficient must be consumed as a whole, a complex one (re,im) only with the vanishing imaginary part
+		std::istringstream coefficient(token);
+		cpx c = 0;
+		double re = 0;
+		if (!(token.front() == '(' ? bool(coefficient >> c) : bool(coefficient >> re)) || !(coefficient >> std::ws).eof())
+			this->fail("Malformed coefficient of a Pauli string\n", line_num);
+		if (token.front() == '(' && c.imag() != 0.0)
+			this->fail("Complex coefficient - the Pauli strings must have real coefficients for a Hermitian H\n", line_num);
+		if (token.front() == '(')
+			re = c.real();
+		v_1d<std::pair<char, int>> ops;
+		while (stream >> token) {
+			if (token.size() < 2 || token.size() > 4 || !std::all_of(token.begin() + 1, token.end(), [](char x) { return std::isdigit(static_cast<unsigned char>(x)); }))
+				this->fail("Malformed Pauli operator, expected P<site>\n", line_num);
+			ops.push_back(std::make_pair(char(std::toupper(token[0])), std::stoi(token.substr(1))));
+		}
+		this->add_string(re, ops, line_num);
+	}
+}
+
+/*
+* @brief reads the strings from a binary file
+*/
+template <typename _type>
+inline void PauliStrings<_type>::read_binary(std::ifstream& file)
+{
+	std::uint32_t n_ops = 0;
+	while (file.read(reinterpret_cast<char*>(&n_ops), sizeof(n_ops))) {
+		double re = 0, im = 0;
+		file.read(reinterpret_cast<char*>(&re), sizeof(re));
+		file.read(reinterpret_cast<char*>(&im), sizeof(im));
+		v_1d<std::pair<char, int>> ops(n_ops);
+		for (auto& [op, site] : ops) {
+			std::int32_t s = 0;
+			file.read(&op, sizeof(op));
+			file.read(reinterpret_cast<char*>(&s), sizeof(s));
+			site = s;
+		}
+		if (!file)
+			this->fail("Truncated binary Pauli strings file\n");
+		if (im != 0.0)
+			this->fail("Complex coefficient - the Pauli strings must have real coefficients for a Hermitian H\n");
+		this->add_string(re, ops);
+	}
+}
+
+// ----------------------------------------------------------------------------- BUILDING HAMILTONIAN -----------------------------------------------------------------------------
+
+/*
+* @brief Adds the strings to the terms table. X flips the spin, Z gives the spin s and Y = i s with the flip,
+* so a string is c i^{nY} prod_{Y,Z} s_i with the flip mask on the X and Y sites.
+* @param t table to be filled
+*/
+template <typename _type>
+void PauliStrings<_type>::build_terms(hamilTerms<_type>& t) const {
+	for (const auto& [c, ops] : this->strings) {
+		u64 x = 0, z = 0;
+		int n_y = 0;
+		for (const auto& [op, site] : ops) {
+			if (op != 'Z') x |= t.site(site);
+			if (op != 'X') z |= t.site(site);
+			n_y += op == 'Y';
+		}
+		// i^{nY}
+		if (n_y % 2 == 0)
+			t.add_off(x, z, (n_y % 4 == 0) ? c : _type(-c));
+		else if constexpr (std::is_same_v<_type, cpx>)
+			t.add_off(x, z, (n_y % 4 == 1) ? imn * c : -imn * c);
+		else
+			this->fail("Odd number of Y operators in a real Hamiltonian\n");
+	}
+}
+
+#endif // !PAULISTRINGS
@@ -0,0 +1,81 @@
+#pragma once
+#ifndef COMMON_H
+#include "../../src/common.h"
+#endif
+
+#ifndef ENTANGLEMENT_H
+#define ENTANGLEMENT_H
+
+/*
+* @brief Entanglement of the pure states for the bipartitions into the first A_size sites (the highest bits) and the rest.
+* The state vector is a column-major dimB x dimA matrix psi(b, a) = <a b|psi> without any copy, and the reduced
+* density matrix psi^+ psi has the same nonzero spectrum as the Gram matrix of the smaller side, the squared Schmidt
+* values, so only min(dimA, dimB) eigenvalues are needed for every cut and every Renyi order.
+*/
+namespace entanglement {
+
+	/*
+	* @brief reshapes the state into the dimB x dimA matrix using the memory of the vector
+	*/
+	template <typename _type>
+	inline const Mat<_type> as_matrix(const Col<_type>& state, int Ns, int A_size) {
+		const u64 dimA = ULLPOW(A_size);
+		const u64 dimB = ULLPOW(Ns - A_size);
+		if (dimA * dimB != state.n_elem)
+			throw "The state does not match the number of sites of the bipartition\n";
+		return Mat<_type>(const_cast<_type*>(state.memptr()), dimB, dimA, false, true);
+	}
+
+	/*
+	* @brief reduced density matrix of the subsystem A
+	*/
+	template <typename _type>
+	inline Mat<_type> red_dens_mat(const Col<_type>& state, int Ns, int A_size) {
+		const Mat<_type> psi = as_matrix(state, Ns, A_size);
+		return psi.t() * psi;
+	}
+
+	/*
+	* @brief squared Schmidt values of the bipartition in the decreasing order, from the Gram matrix of the smaller side
+	*/
+	template <typename _type>
+	inline vec schmidt_spectrum(const Col<_type>& state, int Ns, int A_size) {
+		const Mat<_type> psi = as_matrix(state, Ns, A_size);
+		vec lambda;
+		if (psi.n_cols <= psi.n_rows)	arma::eig_sym(lambda, Mat<_type>(psi.t() * psi));
+		else							arma::eig_sym(lambda, Mat<_type>(psi * psi.t()));
+		return arma::reverse(arma::clamp(lambda, 0.0, 1.0));
+	}
+
+	/*
+	* @brief Renyi entropy of the order n from the squared Schmidt values, n = 1 is the von Neumann entropy
+	*/
+	inline double renyi(const vec& lambda, double n) {
+		if (valueEqualsPrec(n, 1.0, 1e-12)) {
+			double entropy = 0;
+			for (const auto value : lambda)
+				entropy += (value < 1e-10) ? 0 : -value * std::log(value);
+			return entropy;
+		}
+		return std::log(arma::accu(arma::pow(lambda, n))) / (1.0 - n);
+	}
+
+	/*
+	* @brief entropies of all the cuts A = {0, ..., i - 1}, i = 1, ..., Ns - 1, computed in parallel over the cuts
+	* @param orders Renyi orders, each from the same spectrum of the cut
+	* @returns (Ns - 1) x orders matrix
+	*/
+	template <typename _type>
+	inline mat sweep(const Col<_type>& state, int Ns, const v_1d<double>& orders = { 1.0 }) {
+		mat entropy(Ns - 1, orders.size(), arma::fill::zeros);
+#pragma omp parallel for schedule(dynamic)
+		for (int i = 1; i < Ns; i++) {
+			const vec lambda = schmidt_spectrum(state, Ns, i);
+			for (auto j = 0; j < orders.size(); j++)
+				entropy(i - 1, j) = renyi(lambda, orders[j]);
+		}
+		return entropy;
+	}
+}
+
+#endif
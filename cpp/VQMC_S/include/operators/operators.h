@@ -2,6 +2,9 @@
 #ifndef LATTICE_H
 	#include "../lattice.h"
 #endif
+#ifndef ENTANGLEMENT_H
+	#include "./entanglement.h"
+#endif
 
 
 #ifndef OPERATORS_H
@@ -9,7 +12,33 @@
 #include <queue>
 
 
-using op_type = std::function<std::pair<u64, cpx>(u64, int, std::vector<int>)>;
+/*
+* @brief Compile-time kernels of the Pauli operators acting on the sites encoded in the bit mask (the site i is
+* the bit Ns - 1 - i), each returning the new state and the value of the product over the mask.
+*/
+namespace op_kernels {
+	// bit mask of the sites
+	inline u64 mask(int Ns, const v_1d<int>& sites) {
+		u64 m = 0;
+		for (auto const& site : sites)
+			m ^= u64(1) << (Ns - 1 - site);
+		return m;
+	};
+
+	struct sigma_x {
+		std::pair<u64, cpx> operator()(u64 state, u64 mask) const { return std::make_pair(state ^ mask, cpx(1.0)); };
+	};
+	struct sigma_y {
+		// i for the up and -i for the down spins
+		std::pair<u64, cpx> operator()(u64 state, u64 mask) const {
+			static constexpr cpx i_pow[4] = { cpx(1.0, 0.0), cpx(0.0, 1.0), cpx(-1.0, 0.0), cpx(0.0, -1.0) };
+			return std::make_pair(state ^ mask, i_pow[std::popcount(mask) & 3] * popcount_sign(mask, state));
+		};
+	};
+	struct sigma_z {
+		std::pair<u64, cpx> operator()(u64 state, u64 mask) const { return std::make_pair(state, cpx(popcount_sign(mask, state))); };
+	};
+};
 
 class avOperators {
 public:
@@ -33,6 +62,7 @@ public:
 
 	// entropy
 	vec ent_entro;
+	vec ent_renyi2;
 
 	// energy
 	cpx en = 0.0;
@@ -54,6 +84,7 @@ public:
 		this->s_x_cor = mat(Ns, Ns, arma::fill::zeros);
 		this->s_x_i = arma::cx_vec(Ns, arma::fill::zeros);
 		this->ent_entro = arma::vec(Ns - 1, arma::fill::zeros);
+		this->ent_renyi2 = arma::vec(Ns - 1, arma::fill::zeros);
 	};
 
 	void reset() {
@@ -70,6 +101,7 @@ public:
 		this->s_x_cor = mat(Ns, Ns, arma::fill::zeros);
 		this->s_x_i = arma::cx_vec(Ns, arma::fill::zeros);
 		this->ent_entro = arma::vec(Ns - 1, arma::fill::zeros);
+		this->ent_renyi2 = arma::vec(Ns - 1, arma::fill::zeros);
 	};
 
 	void normalise(u64 norm, const v_3d<int>& spatialNorm) {
@@ -174,24 +206,22 @@ public:
 	// -----------------------------------------------  				   AVERAGE OPERATOR 				    ----------------------------------------------
 	
 	// calculates the matrix element of operator at given sites (sum)
-	cpx av_operator(const Col<_type>& alfa, const Col<_type>& beta, op_type op);
+	template <typename _op> cpx av_operator(const Col<_type>& alfa, const Col<_type>& beta, _op op);
 	// calculates the matrix element of operator at given sites
-	cpx av_operator(const Col<_type>& alfa, const Col<_type>& beta, op_type op, std::vector<int> sites);
+	template <typename _op> cpx av_operator(const Col<_type>& alfa, const Col<_type>& beta, _op op, std::vector<int> sites);
 	// calculates the matrix element of operator at given site in extensive form (a sum) with pair sites
-	cpx av_operator(const Col<_type>& alfa, const Col<_type>& beta, op_type op, int site_a, int site_b);
-	// calculates the matrix element of operator at given site in extensive form (a sum) with corr_len
-	cpx av_operator(const Col<_type>& alfa, const Col<_type>& beta, op_type op, int corr_len);
+	template <typename _op> cpx av_operator(const Col<_type>& alfa, const Col<_type>& beta, _op op, int site_a, int site_b);
 
 	// -----------------------------------------------				 SINGLE (diagonal elements)
 	
 	// calculates the matrix element of operator at given sites (sum)
-	cpx av_operator(const Col<_type>& alfa, op_type op);
+	template <typename _op> cpx av_operator(const Col<_type>& alfa, _op op);
 	// calculates the matrix element of operator at given sites
-	cpx av_operator(const Col<_type>& alfa, op_type op, std::vector<int> sites);
+	template <typename _op> cpx av_operator(const Col<_type>& alfa, _op op, std::vector<int> sites);
 	// calculates the matrix element of operator at given site in extensive form (a sum) with pair sites
-	cpx av_operator(const Col<_type>& alfa, op_type op, int site_a, int site_b);
-	// calculates the matrix element of operator at given site in extensive form (a sum) with corr_len
-	cpx av_operator(const Col<_type>& alfa, op_type op, int corr_len);
+	template <typename _op> cpx av_operator(const Col<_type>& alfa, _op op, int site_a, int site_b);
+	// all the sigma_z and sigma_x averages and correlations in a single sweep over the state
+	void av_spin_operators(const Col<_type>& alfa, avOperators& av_op) const;
 
 	// -----------------------------------------------  				   ENTROPY 				    ----------------------------------------------
 
@@ -202,6 +232,7 @@ public:
 	//double entanglement_entropy(const std::map<u64, _type>& state, int A_size) const;									// entanglement entropy with a map
 	//double entanglement_entropy(const std::priority_queue<u64, _type>& state, int A_size) const;						// entanglement entropy with a priority queue
 	vec entanglement_entropy_sweep(const Col<_type>& state) const;														// entanglement entropy sweep over bonds
+	mat renyi_entropy_sweep(const Col<_type>& state, const v_1d<double>& orders) const;									// Renyi entropies sweep over bonds
 	//vec entanglement_entropy_sweep(const std::map<u64, _type>& state) const;											// entanglement entropy sweep over bonds with a map
 	//vec entanglement_entropy_sweep(const std::priority_queue<u64, _type>& state) const;									// entanglement entropy sweep over bonds with a priority queue
 
@@ -213,114 +244,138 @@ public:
 };
 
 
+/*
+* @brief <alfa|O_j|beta> averaged over the sites j
+*/
 template<typename _type>
-inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, const Col<_type>& beta, op_type op)
+template<typename _op>
+inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, const Col<_type>& beta, _op op)
 {
 	cpx value = 0;
 #pragma omp parallel for reduction (+: value)
-	for (int k = 0; k < alfa.n_elem; k++) {
+	for (long long k = 0; k < alfa.n_elem; k++) {
 		for (int j = 0; j < Ns; j++) {
-			const auto& [new_idx, val] = op(k, Ns, v_1d<int>(1, j));
+			const auto [new_idx, val] = op(k, u64(1) << (Ns - 1 - j));
 			value += val * conj(alfa(new_idx)) * beta(k);
 		}
 	}
 	return value / double(this->Ns);
 }
 
+/*
+* @brief <alfa|O_j|beta> summed over the given sites
+*/
 template<typename _type>
-inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, const Col<_type>& beta, op_type op, std::vector<int> sites)
+template<typename _op>
+inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, const Col<_type>& beta, _op op, std::vector<int> sites)
 {
 	for (auto& site : sites)
 		if (site < 0 || site >= this->Ns) throw "Site index exceeds chain";
 	cpx value = 0;
 #pragma omp parallel for reduction (+: value)
-	for (int k = 0; k < alfa.n_elem; k++) {
+	for (long long k = 0; k < alfa.n_elem; k++) {
 		for (auto const& site : sites) {
-			const auto& [new_idx, val] = op(k, Ns, v_1d<int>(1, site));
+			const auto [new_idx, val] = op(k, u64(1) << (Ns - 1 - site));
 			value += val * conj(alfa(new_idx)) * beta(k);
 		}
 	}
 	return value;
 }
 
+/*
+* @brief <alfa|O_a O_b|beta>
+*/
 template<typename _type>
-inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, const Col<_type>& beta, op_type op, int site_a, int site_b)
+template<typename _op>
+inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, const Col<_type>& beta, _op op, int site_a, int site_b)
 {
 	if (site_a < 0 || site_b < 0 || site_a >= this->Ns || site_b >= this->Ns) throw "Site index exceeds chain";
+	const u64 mask = op_kernels::mask(this->Ns, { site_a, site_b });
 	cpx value = 0;
 #pragma omp parallel for reduction (+: value)
-	for (int k = 0; k < alfa.n_elem; k++) {
-		const auto& [new_idx, val] = op(k, Ns, v_1d<int>{site_a, site_b});
+	for (long long k = 0; k < alfa.n_elem; k++) {
+		const auto [new_idx, val] = op(k, mask);
 		value += val * conj(alfa(new_idx)) * beta(k);
 	}
 	return value;
 }
 
 template<typename _type>
-inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, const Col<_type>& beta, op_type op, int corr_len)
+template<typename _op>
+inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, _op op)
 {
-	return cpx();
+	return this->av_operator(alfa, alfa, op);
 }
 
 template<typename _type>
-inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, op_type op)
+template<typename _op>
+inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, _op op, std::vector<int> sites)
 {
-	cpx value = 0;
-	//stout << alfa << EL;
-#pragma omp parallel for reduction (+: value)
-	for (int k = 0; k < alfa.n_elem; k++) {
-		for (int j = 0; j < Ns; j++) {
-			const auto& [new_idx, val] = op(k, Ns, v_1d<int>(1, j));
-			value += val * conj(alfa(new_idx)) * alfa(k);
-			//stout << VEQ(k) << "," << VEQ(new_idx) << "," << VEQ(val) << ", " << VEQ(value) << EL;
-		}
-	}
-	return value / double(this->Ns);
+	return this->av_operator(alfa, alfa, op, sites);
 }
 
 template<typename _type>
-inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, op_type op, std::vector<int> sites)
+template<typename _op>
+inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, _op op, int site_a, int site_b)
 {
-	for (auto& site : sites)
-		if (site < 0 || site >= this->Ns) throw "Site index exceeds chain";
-	cpx value = 0;
-	//stout << alfa << EL;
-#pragma omp parallel for reduction (+: value)
-	for (int k = 0; k < alfa.n_elem; k++) {
-		for (auto const& site : sites) {
-			const auto& [new_idx, val] = op(k, Ns, v_1d<int>(1, site));
-			value += val * conj(alfa(new_idx)) * alfa(k);
-			//stout << VEQ(k) << "," << VEQ(new_idx) << "," << VEQ(val) << ", " << VEQ(value) << "," << VEQ(site) << EL;
-		}
-	}
-	return value;
+	return this->av_operator(alfa, alfa, op, site_a, site_b);
 }
 
+/*
+* @brief Calculates all the sigma_z and sigma_x averages and correlations in a single parallel sweep over the basis.
+* The sigma_z ones are diagonal and need only |alfa_k|^2 with the signs of the bits, the sigma_x ones read
+* alfa at the flipped states. Each thread accumulates its own arrays that are summed at the end.
+* @param alfa state in the full basis
+* @param av_op averages to be filled
+*/
 template<typename _type>
-inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, op_type op, int site_a, int site_b)
+inline void Operators<_type>::av_spin_operators(const Col<_type>& alfa, avOperators& av_op) const
 {
-	if (site_a < 0 || site_b < 0 || site_a >= this->Ns || site_b >= this->Ns) throw "Site index exceeds chain";
-	cpx value = 0;
-	//stout << alfa << EL;
-#pragma omp parallel for reduction (+: value)
-	for (int k = 0; k < alfa.n_elem; k++) {
-		const auto& [new_idx, val] = op(k, Ns, v_1d<int>{site_a, site_b});
-		value += val * conj(alfa(new_idx)) * alfa(k);
-		//stout << VEQ(k) << "," << VEQ(new_idx) << "," << VEQ(val) << ", " << VEQ(value) << "," << VEQ(site_a) << "," << VEQ(site_b) << EL;
+	const int Ns = this->Ns;
+	vec s_z_i(Ns, arma::fill::zeros);
+	mat s_z_cor(Ns, Ns, arma::fill::zeros);
+	vec s_x_i(Ns, arma::fill::zeros);
+	mat s_x_cor(Ns, Ns, arma::fill::zeros);
+#pragma omp parallel
+	{
+		vec z_i(Ns, arma::fill::zeros), spins(Ns);
+		mat z_cor(Ns, Ns, arma::fill::zeros);
+		vec x_i(Ns, arma::fill::zeros);
+		mat x_cor(Ns, Ns, arma::fill::zeros);
+#pragma omp for
+		for (long long k = 0; k < alfa.n_elem; k++) {
+			const double prob = std::norm(alfa(k));
+			for (int i = 0; i < Ns; i++)
+				spins(i) = checkBit(k, Ns - 1 - i) ? 1.0 : -1.0;
+			for (int i = 0; i < Ns; i++) {
+				z_i(i) += prob * spins(i);
+				for (int j = 0; j < Ns; j++)
+					z_cor(i, j) += prob * spins(i) * spins(j);
+				const u64 flip_i = k ^ (u64(1) << (Ns - 1 - i));
+				x_i(i) += std::real(conj(alfa(flip_i)) * alfa(k));
+				for (int j = 0; j < Ns; j++)
+					x_cor(i, j) += std::real(conj(alfa(flip_i ^ (u64(1) << (Ns - 1 - j)))) * alfa(k));
+			}
+		}
+#pragma omp critical
+		{
+			s_z_i += z_i;
+			s_z_cor += z_cor;
+			s_x_i += x_i;
+			s_x_cor += x_cor;
+		}
 	}
-	return value;
+	av_op.s_z_i = s_z_i;
+	av_op.s_z_cor += s_z_cor;
+	av_op.s_z = arma::mean(s_z_i);
+	av_op.s_x_i = arma::conv_to<cx_vec>::from(s_x_i);
+	av_op.s_x_cor += s_x_cor;
+	av_op.s_x = arma::mean(s_x_i);
 }
 
-template<typename _type>
-inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, op_type op, int corr_len)
-{
-	return cpx();
-}
-
-
 // ----------------------------   				   ENTROPY  				    ----------------------------------
 /*
-* @brief Calculates the reduced density matrix of the system via the mixed density matrix
+* @brief Calculates the reduced density matrix of the system from the state reshaped into the dimB x dimA matrix
 * @param state state to produce the density matrix
 * @param A_size size of subsystem
 * @returns reduced density matrix
@@ -328,87 +383,41 @@ inline cpx Operators<_type>::av_operator(const Col<_type>& alfa, op_type op, int
 template<typename _type>
 inline Mat<_type> Operators<_type>::red_dens_mat(const Col<_type>& state, int A_size) const
 {
-	// set subsytsems size
-	const u64 dimA = ULLPOW(A_size);
-	const u64 dimB = ULLPOW(Ns - A_size);
-	const u64 Nh = state.n_elem;
-
-	Mat<_type> rho(dimA, dimA, arma::fill::zeros);
-	// loop over configurational basis
-	for (auto n = 0; n < Nh; n++) {
-		u64 counter = 0;
-		// pick out state with same B side (last L-A_size bits)
-		for (u64 m = n % dimB; m < Nh; m += dimB) {
-			// find index of state with same B-side (by dividing the last bits are discarded)
-			u64 idx = n / dimB;
-			rho(idx, counter) += conj(state(n)) * state(m);
-			// increase counter to move along reduced basis
-			counter++;
-		}
-	}
-	return rho;
-}
-
-template<>
-inline Mat<double> Operators<double>::red_dens_mat(const Col<double>& state, int A_size) const
-{
-	// set subsytsems size
-	const u64 dimA = ULLPOW(A_size);
-	const u64 dimB = ULLPOW(Ns - A_size);
-	const u64 Nh = state.n_elem;
-
-	Mat<double> rho(dimA, dimA, arma::fill::zeros);
-	// loop over configurational basis
-	for (auto n = 0; n < Nh; n++) {
-		u64 counter = 0;
-		// pick out state with same B side (last L-A_size bits)
-		for (u64 m = n % dimB; m < Nh; m += dimB) {
-			// find index of state with same B-side (by dividing the last bits are discarded)
-			u64 idx = n / dimB;
-			rho(idx, counter) += (state(n)) * state(m);
-			// increase counter to move along reduced basis
-			counter++;
-		}
-	}
-	return rho;
+	return entanglement::red_dens_mat(state, this->Ns, A_size);
 }
 
 /*
-*  @brief Calculates the entropy of the system via the mixed density matrix
+*  @brief Calculates the entropy of the system from the squared Schmidt values
 *  @param state state to produce the density matrix
 *  @param A_size size of subsystem
 *  @returns entropy of considered systsem
 */
 template<typename _type>
 inline double Operators<_type>::entanglement_entropy(const Col<_type>& state, int A_size) const {
-	Mat<_type> rho = red_dens_mat(state, A_size);
-	vec probabilities;
-	// diagonalize to find probabilities and calculate trace in rho's eigenbasis
-	eig_sym(probabilities, rho);
-
-	double entropy = 0;
-	//#pragma omp parallel for reduction(+: entropy)
-	for (auto i = 0; i < probabilities.size(); i++) {
-		const auto value = probabilities(i);
-		entropy += (abs(value) < 1e-10) ? 0 : -value * log(abs(value));
-	}
-	//double entropy = -real(trace(rho * real(logmat(rho))));
-	return entropy;
+	return entanglement::renyi(entanglement::schmidt_spectrum(state, this->Ns, A_size), 1.0);
 }
 
 /*
-* @brief Calculates the entropy of the system via the mixed density matrix
+* @brief Calculates the entropy of the system for all the bond cuts in parallel
 * @param state state vector to produce the density matrix
 * @returns entropy of considered systsem for different subsystem sizes
 */
 template<typename _type>
 inline vec Operators<_type>::entanglement_entropy_sweep(const Col<_type>& state) const
 {
-	vec entropy(this->Ns - 1, arma::fill::zeros);
-#pragma omp parallel for
-	for (int i = 0; i < this->Ns - 1; i++)
-		entropy(i) = entanglement_entropy(state, i + 1);
-	return entropy;
+	return entanglement::sweep(state, this->Ns).col(0);
+}
+
+/*
+* @brief Calculates the Renyi entropies for all the bond cuts, each cut diagonalized once for all the orders
+* @param state state vector to produce the density matrix
+* @param orders Renyi orders, 1 is the von Neumann entropy
+* @returns entropies with the columns for the orders
+*/
+template<typename _type>
+inline mat Operators<_type>::renyi_entropy_sweep(const Col<_type>& state, const v_1d<double>& orders) const
+{
+	return entanglement::sweep(state, this->Ns, orders);
 }
 
 // -----------------   				   HELPERS  				    -------------------
@@ -416,46 +425,15 @@ template<typename _type>
 inline void Operators<_type>::calculate_operators(const Col<_type>& eigvec, avOperators& av_op, bool cal_entro)
 {
 	
-	// --------------------- compare sigma_z ---------------------
-
-	// S_z_vector extensive
-	av_op.s_z = std::real(this->av_operator(eigvec, this->sigma_z));
-
-	// S_z at each site
-	for (auto i = 0; i < Ns; i++)
-		av_op.s_z_i(i) = std::real(this->av_operator(eigvec, this->sigma_z, v_1d<int>(1, i)));
-	// stout << av_op.s_z_i << EL;
-	// S_z correlations
-	for (auto i = 0; i < Ns; i++) {
-		for (auto j = 0; j < Ns; j++) {
-			//const auto [x, y, z] = this->lat->getSiteDifference(i, j);
-			//av_op.s_z_cor[abs(x)][abs(y)][abs(z)] += std::real(this->av_operator(eigvec, this->sigma_z, i, j)) / this->lat->get_spatial_norm(abs(x), abs(y), abs(z));
-			av_op.s_z_cor(i, j) += std::real(this->av_operator(eigvec, this->sigma_z, i, j));
-			//stout << VEQ(av_op.s_z_cor[abs(x)][abs(y)][abs(z)]) << EL;
-		}
-	}
-	//stout << av_op.s_z_cor << EL;
-	// --------------------- compare sigma_x ---------------------
-	
-	// S_x_vector extensive
-	av_op.s_x = std::real(this->av_operator(eigvec, this->sigma_x));
-
-	// S_x at each site
-	for (auto i = 0; i < Ns; i++)
-		av_op.s_x_i(i) = std::real(this->av_operator(eigvec, this->sigma_x, v_1d<int>(1, i)));
-
-	// S_x correlations
-	for (auto i = 0; i < Ns; i++) {
-		for (auto j = 0; j < Ns; j++) {
-			//const auto [x, y, z] = this->lat->getSiteDifference(i, j);
-			//av_op.s_x_cor[abs(x)][abs(y)][abs(z)] += std::real(this->av_operator(eigvec, this->sigma_x, i, j)) / this->lat->get_spatial_norm(abs(x), abs(y), abs(z));
-			av_op.s_x_cor(i, j) += std::real(this->av_operator(eigvec, this->sigma_x, i, j));
-		}
-	}
+	// --------------------- sigma_z and sigma_x ---------------------
+	this->av_spin_operators(eigvec, av_op);
 
 	// --------------------- entropy ----------------------
-	if(cal_entro)
-		av_op.ent_entro = this->entanglement_entropy_sweep(eigvec);
+	if (cal_entro) {
+		const mat entropies = this->renyi_entropy_sweep(eigvec, { 1.0, 2.0 });
+		av_op.ent_entro = entropies.col(0);
+		av_op.ent_renyi2 = entropies.col(1);
+	}
 }
 
 
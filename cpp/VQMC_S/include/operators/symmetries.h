@@ -0,0 +1,223 @@
+#pragma once
+#ifndef LATTICE_H
+#include "../lattice.h"
+#endif
+
+#ifndef SYMMETRIES_H
+#define SYMMETRIES_H
+
+/*
+* @brief Abelian group of the lattice symmetries of the spin basis - translations, the reflection x -> Lx - 1 - x and
+* the inversion of all the spins - together with the characters of the chosen sector. Every group element is stored as
+* a site permutation (the spin at site i is moved to perm[i]) and an inversion flag. The sector state built on the
+* representative r (the smallest state of its orbit) is |r> = 1/n_r sum_g chi(g)^* g|r>, with n_r^2 = |G| sum_{g r = r} chi(g).
+*/
+class spinSymmetries {
+private:
+	int Ns = 0;																				// number of lattice sites
+	v_2d<int> perms;																		// site permutations of the elements
+	v_1d<bool> inversions;																	// does the element invert all the spins
+	v_1d<cpx> chars;																		// characters of the sector
+	std::string info = "";																	// sector information
+
+	/*
+	* @brief composition of the permutations - first b, then a
+	*/
+	static v_1d<int> compose(const v_1d<int>& a, const v_1d<int>& b) {
+		v_1d<int> c(b.size());
+		for (auto i = 0; i < b.size(); i++)
+			c[i] = a[b[i]];
+		return c;
+	}
+public:
+	~spinSymmetries() = default;
+	spinSymmetries() = default;
+	spinSymmetries(std::shared_ptr<Lattice> lat, bool translations, int qx, int qy, int parity, int spin_flip);
+
+	// ------------------------------------------- 				  GETTERS 				  -------------------------------------------
+	size_t size()											const { return this->perms.size(); };				// order of the group
+	bool empty()											const { return this->perms.size() <= 1; };			// only the identity
+	const cpx& get_char(size_t g)							const { return this->chars[g]; };					// character of the element
+	bool get_inversion(size_t g)							const { return this->inversions[g]; };				// does the element invert the spins
+	auto get_info()											const RETURNS(this->info);							// sector information
+
+	/*
+	* @brief permutes the bits of a state (or of a mask) with the element g, without the spin inversion
+	*/
+	u64 permute(size_t g, u64 s) const {
+		u64 out = 0;
+		for (int i = 0; i < this->Ns; i++)
+			if (checkBit(s, this->Ns - 1 - i))
+				out |= u64(1) << (this->Ns - 1 - this->perms[g][i]);
+		return out;
+	}
+
+	/*
+	* @brief acts with the element g on the basis state
+	*/
+	u64 apply(size_t g, u64 s) const {
+		const u64 out = this->permute(g, s);
+		return this->inversions[g] ? out ^ (this->Ns == 64 ? ~u64(0) : (u64(1) << this->Ns) - 1) : out;
+	}
+
+	/*
+	* @brief finds the representative r of the orbit of s and the character chi(g) of the element with s = g r
+	* @returns (representative, character)
+	*/
+	std::pair<u64, cpx> representative(u64 s) const {
+		u64 r = s;
+		cpx c = 1.0;
+		for (size_t g = 1; g < this->size(); g++) {
+			if (const u64 t = this->apply(g, s); t < r) {
+				r = t;
+				c = this->chars[g];
+			}
+		}
+		// s = g^{-1} r
+		return std::make_pair(r, std::conj(c));
+	}
+
+	/*
+	* @brief normalisation n_r of the sector state built on the representative, 0 if it does not belong to the sector
+	*/
+	double norm(u64 r) const {
+		cpx stab = 0.0;
+		for (size_t g = 0; g < this->size(); g++)
+			if (this->apply(g, r) == r)
+				stab += this->chars[g];
+		return std::abs(stab) < 1e-10 ? 0.0 : std::sqrt(double(this->size()) * std::real(stab));
+	}
+};
+
+/*
+* @brief creates the group and the characters of the sector
+* @param lat lattice - the translations need the square lattice with PBC
+* @param translations use the translations
+* @param qx momentum along x in the units of 2pi/Lx
+* @param qy momentum along y in the units of 2pi/Ly
+* @param parity reflection parity: 0 - not used, +-1 - sector
+* @param spin_flip spin inversion parity: 0 - not used, +-1 - sector
+*/
+inline spinSymmetries::spinSymmetries(std::shared_ptr<Lattice> lat, bool translations, int qx, int qy, int parity, int spin_flip)
+	: Ns(lat->get_Ns())
+{
+	const int Lx = lat->get_Lx();
+	const int Ly = lat->get_Ly();
+	if ((translations || parity != 0) && (lat->get_type() != "square" || lat->get_BC() != 0 || lat->get_Dim() > 2))
+		throw "The lattice symmetries are implemented for the 1D and 2D square lattices with PBC only\n";
+	qx = myModuloEuclidean(qx, Lx);
+	qy = myModuloEuclidean(qy, Ly);
+	if (parity != 0 && ((2 * qx) % Lx != 0 || (2 * qy) % Ly != 0))
+		throw "The reflection parity requires the momenta 0 or pi\n";
+
+	// site at given coordinates
+	auto site = [&](int x, int y) { return myModuloEuclidean(x, Lx) + Lx * myModuloEuclidean(y, Ly); };
+	v_1d<int> identity(this->Ns);
+	for (int i = 0; i < this->Ns; i++)
+		identity[i] = i;
+
+	// translations with their characters
+	v_2d<int> t_perms = { identity };
+	v_1d<cpx> t_chars = { 1.0 };
+	if (translations) {
+		t_perms.clear();
+		t_chars.clear();
+		for (int b = 0; b < Ly; b++) {
+			for (int a = 0; a < Lx; a++) {
+				v_1d<int> perm(this->Ns);
+				for (int i = 0; i < this->Ns; i++)
+					perm[i] = site(lat->get_coordinates(i, 0) + a, lat->get_coordinates(i, 1) + b);
+				t_perms.push_back(perm);
+				t_chars.push_back(std::exp(-imn * double(TWOPI) * (double(qx * a) / Lx + double(qy * b) / Ly)));
+			}
+		}
+	}
+	// reflection
+	v_1d<int> reflection(this->Ns);
+	for (int i = 0; i < this->Ns; i++)
+		reflection[i] = site(Lx - 1 - lat->get_coordinates(i, 0), lat->get_coordinates(i, 1));
+
+	// the elements T R^r Z^z
+	for (int z = 0; z <= (spin_flip != 0); z++) {
+		for (int r = 0; r <= (parity != 0); r++) {
+			for (size_t t = 0; t < t_perms.size(); t++) {
+				this->perms.push_back(r ? compose(t_perms[t], reflection) : t_perms[t]);
+				this->inversions.push_back(z == 1);
+				this->chars.push_back(t_chars[t] * (r ? double(parity) : 1.0) * (z ? double(spin_flip) : 1.0));
+			}
+		}
+	}
+	this->info = (translations ? ",qx=" + STR(qx) + ",qy=" + STR(qy) : "") + \
+		(parity != 0 ? ",par=" + STR(parity) : "") + \
+		(spin_flip != 0 ? ",sf=" + STR(spin_flip) : "");
+}
+
+
+/*
+* @brief Sector of the fixed number of the up spins, conserved by the U(1) symmetric models. The states with n_up set bits
+* are ranked in the combinatorial number system, r(s) = sum_k C(p_k, k) with the positions p_1 < ... < p_n of the set
+* bits, so the rank is the position of s among the sector states in the increasing order and no lookup table is needed.
+*/
+class magnetizationSector {
+private:
+	int Ns = 0;																				// number of lattice sites
+	int n_up = -1;																			// number of the up spins, -1 for the full basis
+	u64 dim = 0;																			// dimension of the sector
+	v_2d<u64> binom;																		// binomial coefficients C(p, k)
+public:
+	~magnetizationSector() = default;
+	magnetizationSector() = default;
+	magnetizationSector(int Ns, int n_up) : Ns(Ns), n_up(n_up) {
+		if (n_up < 0 || n_up > Ns)
+			throw "The number of the up spins must be between 0 and the number of sites\n";
+		this->binom = v_2d<u64>(Ns + 1, v_1d<u64>(Ns + 1, 0));
+		for (int p = 0; p <= Ns; p++) {
+			this->binom[p][0] = 1;
+			for (int k = 1; k <= p; k++)
+				this->binom[p][k] = this->binom[p - 1][k - 1] + (k < p ? this->binom[p - 1][k] : 0);
+		}
+		this->dim = this->binom[Ns][n_up];
+	};
+
+	// ------------------------------------------- 				  GETTERS 				  -------------------------------------------
+	u64 size()												const { return this->dim; };						// dimension of the sector
+	bool empty()											const { return this->n_up < 0; };					// full basis
+	int get_n_up()											const { return this->n_up; };						// number of the up spins
+	std::string get_info()									const { return this->empty() ? "" : ",nup=" + STR(this->n_up); };
+
+	/*
+	* @brief rank of the sector state
+	*/
+	u64 rank(u64 s) const {
+		u64 r = 0;
+		for (int k = 1; s != 0; k++, s &= s - 1)
+			r += this->binom[std::countr_zero(s)][k];
+		return r;
+	}
+
+	/*
+	* @brief sector state of a given rank - the greedy inverse of rank()
+	*/
+	u64 state(u64 idx) const {
+		u64 s = 0;
+		for (int k = this->n_up, p = this->Ns - 1; k > 0; k--, p--) {
+			while (this->binom[p][k] > idx)
+				p--;
+			s |= u64(1) << p;
+			idx -= this->binom[p][k];
+		}
+		return s;
+	}
+
+	/*
+	* @brief next sector state in the increasing order (Gosper's hack), i.e. state(rank(s) + 1)
+	*/
+	static u64 next(u64 s) {
+		if (s == 0) return 0;
+		const u64 c = s & (~s + 1);
+		const u64 r = s + c;
+		return (((r ^ s) >> 2) / c) | r;
+	}
+};
+
+#endif
@@ -0,0 +1,187 @@
+#pragma once
+#ifndef COMMON_H
+#include "../../src/common.h"
+#endif
+
+#ifndef TERMS_H
+#define TERMS_H
+#include <map>
+
+/*
+* @brief Hamiltonian compiled into a flat table of the spin terms acting on the bits of a basis state |s>.
+* The site i corresponds to the bit Ns - 1 - i and the set bit is the spin up (s_i = +1).
+* The product of the spins over a mask Z is (-1)^popcount(Z & ~s), therefore
+*	H|s> = [sum_d c_d prod_{i in Z_d} s_i] |s> + sum_X [sum_k c_{X,k} prod_{i in Z_{X,k}} s_i] |s ^ X>,
+* with the off-diagonal terms grouped by their flip mask X. The terms are accumulated in maps while building,
+* so the same bond added from both of its sites is stored once, and flattened by compile().
+*/
+template <typename _type>
+class hamilTerms {
+private:
+	int Ns = 0;																				// number of lattice sites
+	std::map<u64, _type> diag_map;															// diagonal terms while building
+	std::map<u64, std::map<u64, _type>> off_map;											// off-diagonal terms while building
+
+	v_1d<u64> diag_masks;																	// diagonal sign masks
+	v_1d<_type> diag_vals;																	// diagonal amplitudes
+	v_1d<u64> flips;																		// flip masks of the off-diagonal groups
+	v_1d<size_t> offsets;																	// group g owns the entries [offsets[g], offsets[g+1])
+	v_1d<u64> sign_masks;																	// off-diagonal sign masks
+	v_1d<_type> sign_vals;																	// off-diagonal amplitudes
+public:
+	~hamilTerms() = default;
+	hamilTerms() = default;
+	hamilTerms(int Ns) : Ns(Ns) {};
+
+	// ------------------------------------------- 				  BUILDING 				  -------------------------------------------
+	u64 site(int i)											const { return u64(1) << (this->Ns - 1 - i); };	// bit mask of a site
+
+	/*
+	* @brief adds the diagonal term c prod_{i in z} s_i
+	*/
+	void add_diag(u64 z, _type c) { this->diag_map[z] += c; };
+
+	/*
+	* @brief adds the off-diagonal term c prod_{i in z} s_i |s ^ x>, the empty flip mask is diagonal
+	*/
+	void add_off(u64 x, u64 z, _type c) {
+		if (x == 0)	this->add_diag(z, c);
+		else		this->off_map[x][z] += c;
+	};
+
+	void add_z(int i, _type c)								{ this->add_diag(this->site(i), c); };								// c s^z_i
+	void add_x(int i, _type c)								{ this->add_off(this->site(i), 0, c); };							// c s^x_i
+	void add_zz(int i, int j, _type c)						{ this->add_diag(this->site(i) ^ this->site(j), c); };				// c s^z_i s^z_j
+	void add_xx(int i, int j, _type c)						{ this->add_off(this->site(i) ^ this->site(j), 0, c); };			// c s^x_i s^x_j
+	void add_yy(int i, int j, _type c)						{ const u64 x = this->site(i) ^ this->site(j); this->add_off(x, x, -c); };	// c s^y_i s^y_j = -c s_i s_j flipped
+	/*
+	* @brief adds the hopping c (s^+_i s^-_j + s^-_i s^+_j), which acts only on the antiparallel spins:
+	* c/2 (1 - s_i s_j) with both spins flipped
+	*/
+	void add_hop(int i, int j, _type c) {
+		const u64 x = this->site(i) ^ this->site(j);
+		this->add_off(x, 0, 0.5 * c);
+		this->add_off(x, x, -0.5 * c);
+	};
+
+	/*
+	* @brief flattens the accumulated terms and drops the vanishing ones
+	*/
+	void compile() {
+		auto vanishing = [](_type c) { return valueEqualsPrec(std::abs(c), 0.0, 1e-14); };
+		this->diag_masks.clear(); this->diag_vals.clear();
+		this->flips.clear(); this->sign_masks.clear(); this->sign_vals.clear();
+		this->offsets = { 0 };
+		for (const auto& [z, c] : this->diag_map) {
+			if (vanishing(c)) continue;
+			this->diag_masks.push_back(z);
+			this->diag_vals.push_back(c);
+		}
+		for (const auto& [x, group] : this->off_map) {
+			for (const auto& [z, c] : group) {
+				if (vanishing(c)) continue;
+				this->sign_masks.push_back(z);
+				this->sign_vals.push_back(c);
+			}
+			if (this->sign_masks.size() == this->offsets.back()) continue;
+			this->flips.push_back(x);
+			this->offsets.push_back(this->sign_masks.size());
+		}
+	}
+
+	// ------------------------------------------- 				  EVALUATION 				  -------------------------------------------
+	size_t get_off_num()									const { return this->flips.size(); };				// number of off-diagonal groups
+	size_t get_diag_num()									const { return this->diag_masks.size(); };			// number of diagonal terms
+	u64 get_flip(size_t g)									const { return this->flips[g]; };					// flip mask of the group
+
+	/*
+	* @brief checks if the terms are invariant under a transformation of the sites combined with the optional
+	* inversion of all the spins, which changes the sign of the terms with an odd number of spins in the sign mask
+	* @param transform transformation of the masks
+	* @param inversion is the transformation inverting the spins
+	*/
+	template <typename _F>
+	bool invariant(_F transform, bool inversion) const {
+		auto parity = [&](u64 z) { return (inversion && (std::popcount(z) & 1)) ? -1.0 : 1.0; };
+		auto differs = [](const std::map<u64, _type>& mp, u64 z, _type c) {
+			const auto it = mp.find(z);
+			return !valueEqualsPrec(std::abs((it == mp.end() ? _type(0.0) : it->second) - c), 0.0, 1e-10);
+		};
+		for (const auto& [z, c] : this->diag_map)
+			if (differs(this->diag_map, transform(z), parity(z) * c))
+				return false;
+		for (const auto& [x, group] : this->off_map) {
+			const auto it = this->off_map.find(transform(x));
+			if (it == this->off_map.end())
+				return false;
+			for (const auto& [z, c] : group)
+				if (differs(it->second, transform(z), parity(z) * c))
+					return false;
+		}
+		return true;
+	}
+
+	/*
+	* @brief checks if the terms conserve the number of the up spins. The group X acting on s changes it unless half of
+	* the flipped spins are up, so the element of the group must vanish for all the other states. Each sign mask splits
+	* into A = Z & X and C = Z & ~X and the characters of the distinct C are independent, so for every C separately
+	* g(s) = sum_k c_k prod_{i in A_k} s_i must vanish on the flipped bits s_X away from the half filling. This is
+	* impossible when |X| is odd, when a flipped bit is in none of the A_k (flipping it leaves g but moves the filling),
+	* or when the m terms violate the uncertainty bound m C(|X|, |X|/2) >= 2^|X| of a function supported on the half
+	* filling. Only the remaining groups are enumerated over the flipped bits, at most 2^max_bits states.
+	* @param max_bits the largest number of the flipped spins enumerated
+	*/
+	bool conserves_magnetization(int max_bits = 20) const {
+		for (size_t g = 0; g < this->flips.size(); g++) {
+			const u64 x = this->flips[g];
+			const int n = std::popcount(x);
+			if (n % 2 != 0)
+				return false;
+			// (A, c) pairs for each part C of the sign masks outside of the flip
+			std::map<u64, v_1d<std::pair<u64, _type>>> parts;
+			for (size_t k = this->offsets[g]; k < this->offsets[g + 1]; k++)
+				parts[this->sign_masks[k] & ~x].push_back(std::make_pair(this->sign_masks[k] & x, this->sign_vals[k]));
+			const double log_half = std::lgamma(n + 1.0) - 2.0 * std::lgamma(n / 2 + 1.0);
+			for (const auto& [c_mask, part] : parts) {
+				u64 u = 0;
+				for (const auto& [a, c] : part)
+					u |= a;
+				if (u != x || std::log(double(part.size())) + log_half < n * std::log(2.0) - 1e-10)
+					return false;
+				if (n > max_bits)
+					throw "The conservation of the magnetization cannot be verified for so many flipped spins\n";
+				for (u64 s = x;; s = (s - 1) & x) {
+					_type val = 0.0;
+					for (const auto& [a, c] : part)
+						val += c * popcount_sign(a, s);
+					if (2 * std::popcount(s) != n && !valueEqualsPrec(std::abs(val), 0.0, 1e-14))
+						return false;
+					if (s == 0) break;
+				}
+			}
+		}
+		return true;
+	}
+
+	/*
+	* @brief diagonal element <s|H|s>
+	*/
+	_type diagonal(u64 state) const {
+		_type val = 0.0;
+		for (size_t d = 0; d < this->diag_masks.size(); d++)
+			val += this->diag_vals[d] * popcount_sign(this->diag_masks[d], state);
+		return val;
+	}
+
+	/*
+	* @brief element <s ^ X_g|H|s> of the off-diagonal group g
+	*/
+	_type off_diagonal(size_t g, u64 state) const {
+		_type val = 0.0;
+		for (size_t k = this->offsets[g]; k < this->offsets[g + 1]; k++)
+			val += this->sign_vals[k] * popcount_sign(this->sign_masks[k], state);
+		return val;
+	}
+};
+
+#endif
@@ -14,6 +14,9 @@
 #ifndef ISINGMODEL
 #include "models/ising.h"
 #endif
+#ifndef PAULISTRINGS
+#include "models/pauli_strings.h"
+#endif
 
 #ifndef OPERATORS_H
 #include "operators/operators.h"
@@ -23,31 +26,235 @@
 #include "../include/ml.h"
 #endif
 
-
-#ifdef PINV
-constexpr auto pinv_tol = 5e-5;
-#ifdef S_REGULAR
-#undef S_REGULAR
+#ifndef SR_H
+#include "../include/sr.h"
 #endif
-#elif defined S_REGULAR 
 
-#ifdef PINV
-#undef PINV
-#endif
-#endif
 
 
+#ifdef RBM_BATCH_LOCEN
+constexpr size_t loc_en_batch_cols = 4096;                      // maximal number of connected states in a single GEMM
+#endif
 
 constexpr double lambda_0_reg = 100;
 constexpr double b_reg = 0.9;
 constexpr double lambda_min_reg = 1e-4;
 
 
+/*
+* @brief Variational derivatives of all samples in a single Monte Carlo step stored in the factored form.
+* The derivative of the sample k is O_k = [v_k; tanh(theta_k); vec(tanh(theta_k) v_k^T)], so only the pair
+* (v_k, tanh(theta_k)) is kept - n_visible + n_hidden values instead of full_size. When the mean derivative is set
+* the storage represents the centered derivatives Oc = O - <O>.
+*/
+template <typename _type>
+struct rbmDerivatives {
+    size_t n_visible = 0;                                       // visible neurons
+    size_t n_hidden = 0;                                        // hidden neurons
+    Mat<double> V;                                              // visible configurations of the samples (columns)
+    Mat<_type> Th;                                              // hyperbolic tangents of the angles of the samples (columns)
+    Col<_type> m;                                               // mean derivative, empty when not centered
+
+    rbmDerivatives() = default;
+    rbmDerivatives(size_t n_visible, size_t n_hidden, size_t n_samples)
+        : n_visible(n_visible), n_hidden(n_hidden)
+        , V(n_visible, n_samples, arma::fill::zeros)
+        , Th(n_hidden, n_samples, arma::fill::zeros)
+    {};
+
+    // number of the variational parameters
+    size_t full_size()                                          const { return this->n_visible + this->n_hidden + this->n_visible * this->n_hidden; };
+
+    /*
+    * @brief mean derivative <O>
+    */
+    Col<_type> mean() const {
+        Col<_type> out(this->full_size());
+        out.head(this->n_visible) = arma::conv_to<Col<_type>>::from(Col<double>(arma::mean(this->V, 1)));
+        out.subvec(this->n_visible, this->n_visible + this->n_hidden - 1) = arma::mean(this->Th, 1);
+        out.tail(this->n_visible * this->n_hidden) = arma::vectorise(Mat<_type>(this->Th * this->V.t())) / double(this->V.n_cols);
+        return out;
+    }
+
+    /*
+    * @brief centers the derivatives - only the mean is stored, the factors are kept
+    * @param mean mean derivative
+    */
+    void center(const Col<_type>& mean)                         { this->m = mean; };
+
+    /*
+    * @brief not centered O^T x = V^T x_v + Th^T x_h + colsum(Th % (X V)) with X the weights part reshaped
+    */
+    Col<_type> Ot_raw(const Col<_type>& x) const {
+        const Mat<_type> X(x.memptr() + this->n_visible + this->n_hidden, this->n_hidden, this->n_visible);
+        return this->V.t() * x.head(this->n_visible) + this->Th.st() * x.subvec(this->n_visible, this->n_visible + this->n_hidden - 1)
+            + arma::sum(this->Th % Mat<_type>(X * this->V), 0).st();
+    }
+
+    /*
+    * @brief not centered O y = [V y; Th y; vec(Th diag(y) V^T)]
+    */
+    Col<_type> O_raw(const Col<_type>& y) const {
+        Col<_type> out(this->full_size());
+        out.head(this->n_visible) = this->V * y;
+        out.subvec(this->n_visible, this->n_visible + this->n_hidden - 1) = this->Th * y;
+        out.tail(this->n_visible * this->n_hidden) = arma::vectorise(Mat<_type>((this->Th.each_row() % y.st()) * this->V.t()));
+        return out;
+    }
+
+    /*
+    * @brief materializes the rows [first, last] of the derivatives (parameters x samples), centered if the mean is set.
+    * The weight W(h, v) is the parameter n_visible + n_hidden + h + n_hidden * v.
+    */
+    Mat<_type> rows(size_t first, size_t last) const {
+        Mat<_type> out(last - first + 1, this->V.n_cols);
+        for (size_t r = first; r <= last; r++) {
+            if (r < this->n_visible)
+                out.row(r - first) = arma::conv_to<Row<_type>>::from(Row<double>(this->V.row(r)));
+            else if (r < this->n_visible + this->n_hidden)
+                out.row(r - first) = this->Th.row(r - this->n_visible);
+            else {
+                const size_t w = r - this->n_visible - this->n_hidden;
+                out.row(r - first) = this->Th.row(w % this->n_hidden) % this->V.row(w / this->n_hidden);
+            }
+        }
+        if (!this->m.is_empty())
+            out.each_col() -= this->m.subvec(first, last);
+        return out;
+    }
+
+    /*
+    * @brief materializes the full derivatives (parameters x samples), centered if the mean is set
+    */
+    Mat<_type> full() const {
+        Mat<_type> out(this->full_size(), this->V.n_cols);
+        for (auto k = 0; k < this->V.n_cols; k++) {
+            out.col(k).head(this->n_visible) = arma::conv_to<Col<_type>>::from(Col<double>(this->V.col(k)));
+            out.col(k).subvec(this->n_visible, this->n_visible + this->n_hidden - 1) = this->Th.col(k);
+            out.col(k).tail(this->n_visible * this->n_hidden) = arma::vectorise(Mat<_type>(this->Th.col(k) * this->V.col(k).t()));
+        }
+        if (!this->m.is_empty())
+            out.each_col() -= this->m;
+        return out;
+    }
+};
+
+// ----------------------------------------------------------------------------- FACTORED DERIVATIVES FOR THE SR SOLVERS
+
+template <typename _type>
+inline size_t sr_samples(const rbmDerivatives<_type>& Oc) {
+    return Oc.V.n_cols;
+}
+
+/*
+* @brief Oc^T x = O^T x - (m^T x) 1
+*/
+template <typename _type>
+inline Col<_type> sr_Ot(const rbmDerivatives<_type>& Oc, const Col<_type>& x) {
+    Col<_type> out = Oc.Ot_raw(x);
+    if (!Oc.m.is_empty())
+        out -= arma::dot(Oc.m, x);
+    return out;
+}
+
+/*
+* @brief Oc y = O y - m sum(y)
+*/
+template <typename _type>
+inline Col<_type> sr_O(const rbmDerivatives<_type>& Oc, const Col<_type>& y) {
+    Col<_type> out = Oc.O_raw(y);
+    if (!Oc.m.is_empty())
+        out -= arma::sum(y) * Oc.m;
+    return out;
+}
+
+/*
+* @brief block of the parameters of the centered derivatives
+*/
+template <typename _type>
+inline Mat<_type> sr_rows(const rbmDerivatives<_type>& Oc, size_t first, size_t last) {
+    return Oc.rows(first, last);
+}
+
+/*
+* @brief Oc^T Oc^* from the samples Gram matrices - V^T V + Th^T Th^* + (Th^T Th^*) % (V^T V) - and the rank-2 centering
+*/
+template <typename _type>
+inline Mat<_type> sr_gram(const rbmDerivatives<_type>& Oc) {
+    const Mat<double> VV = Oc.V.t() * Oc.V;
+    const Mat<_type> TT = Oc.Th.st() * arma::conj(Oc.Th);
+    Mat<_type> G = TT % VV + TT + VV;
+    if (!Oc.m.is_empty()) {
+        const Col<_type> a = Oc.Ot_raw(Col<_type>(arma::conj(Oc.m)));
+        G.each_col() -= a;
+        G.each_row() -= Row<_type>(arma::conj(a).st());
+        G += arma::dot(Oc.m, arma::conj(Oc.m));
+    }
+    return G;
+}
+
 
+/*
+* @brief Batch of walkers advanced in lockstep by a single thread, stored as structure of arrays: the configurations
+* are the packed states and the angles with their log cosh the n_hidden x n_walkers columns, so the proposals and
+* the accepted updates of all the walkers are whole matrix operations.
+*/
+template <typename _type>
+struct rbmWalkers {
+    Mat<_type> Th;                                              // effective angles of the walkers
+    Mat<_type> LC;                                              // log cosh of the angles
+    v_1d<u64> states;                                           // packed configurations of the walkers
+
+    rbmWalkers() = default;
+    rbmWalkers(size_t n_visible, size_t n_hidden, size_t n_walkers)
+        : Th(n_hidden, n_walkers, arma::fill::zeros)
+        , LC(n_hidden, n_walkers, arma::fill::zeros)
+        , states(n_walkers, 0)
+    {};
+    size_t size()                                               const { return this->states.size(); };
+};
 
+/*
+* @brief Single Markov chain (walker) of the sampler. Each thread owns its own chain with the state vector,
+* the effective angles and an independent random stream so that chains can be advanced without any sharing.
+*/
+template <typename _type, typename _hamtype>
+struct rbmChain {
+    u64 current_state = 0;                                      // current state of the chain - packed spins used by the sampler
+    Col<double> current_vector;                                 // current state vector of the chain - materialised for the products with W
+    Col<double> tmp_vector;                                     // tmp state vector for the proposals
+    Col<_type> thetas;                                          // effective angles of the chain
+    Col<_type> tanh_thetas;                                     // hyperbolic tangents of the angles at the current state
+    Col<_type> flip_log_ratios;                                 // logarithms of the ratios of all the single flips
+    v_1d<size_t> flip_stamps;                                   // stamp of the state at which the cached ratio of the flip was computed
+    size_t stamp = 0;                                           // stamp of the current state of the chain while sampling
+    Col<_type> log_cosh_thetas;                                 // log cosh of the angles while sampling with the angles updates
+    Col<_type> proposed_thetas;                                 // angles of the proposed flip
+    Col<_type> proposed_log_cosh;                               // log cosh of the angles of the proposed flip
+    Mat<_type> flip_thetas;                                     // angles after each of the single flips (columns) in the rejection-free sampler
+    locEnWorkspace<_hamtype> loc_energies;                      // local energies buffer of the chain
+    rbmWalkers<_type> walkers;                                  // walkers advanced in lockstep by the chain
+    randomGen ran;                                              // random stream of the chain
+    bool thermalized = false;                                   // was the chain already thermalized (for persistent chains)
+
+    rbmChain() = default;
+    rbmChain(size_t n_visible, size_t n_hidden, std::uint64_t seed)
+        : current_vector(n_visible, arma::fill::ones)
+        , tmp_vector(n_visible, arma::fill::ones)
+        , thetas(n_hidden, arma::fill::zeros)
+        , tanh_thetas(n_hidden, arma::fill::zeros)
+        , flip_log_ratios(n_visible, arma::fill::zeros)
+        , flip_stamps(n_visible, 0)
+        , log_cosh_thetas(n_hidden, arma::fill::zeros)
+        , proposed_thetas(n_hidden, arma::fill::zeros)
+        , proposed_log_cosh(n_hidden, arma::fill::zeros)
+        , ran(seed)
+    {};
+};
 
 template <typename _type, typename _hamtype>
 class rbmState{
+    using chain = rbmChain<_type, _hamtype>;
 
 private:
 
@@ -70,11 +277,14 @@ private:
     size_t full_size;                                           // full size of the parameters
     size_t hilbert_size;                                        // hilbert space size
     size_t thread_num;                                          // thread number
+    size_t n_chains;                                            // number of independent Markov chains
+    bool persistent = false;                                    // keep the chains between the iterations instead of restarting them
+    impDef::sampler_types sampler = impDef::sampler_types::metropolis;  // Markov chain sampler
+    size_t n_walkers = 1;                                       // walkers advanced in lockstep by each chain
     double lr;                                                  // learning rate
-#ifdef S_REGULAR
     double b_reg_mult = b_reg;                                  // starting parameter for regularisation
-#endif
     double current_b_reg = 0;                                   // parameter for regularisation, changes with Monte Carlo steps
+    bool sr_schedule = false;                                   // use the decaying regularisation schedule of the covariance
 
 
     pBar pbar;                                                  // progress bar
@@ -85,10 +295,10 @@ private:
     Col<_type> b_h;                                             // hidden bias
 
     // variational derivatives                                  
-    Col<_type> thetas;                                          // effective angles
-    Col<_type> O_flat;                                          // flattened output for easier calculation of the covariance
+    rbmDerivatives<_type> derivatives;                          // factored derivatives of all samples in a single Monte Carlo step
     Mat<_type> S;                                               // positive semi-definite covariance matrix
     Col<_type> F;                                               // forces
+    impDef::sr_types sr_type;                                   // type of the stochastic reconfiguration solver
     
     // the Hamiltonian
     std::shared_ptr<SpinHamiltonian<_hamtype>> hamil;           // unique ptr to a general Hamiltonian of the spin system
@@ -96,27 +306,37 @@ private:
     // optimizer
     std::unique_ptr<Adam<_type>> adam;                          // use the Adam optimizer for GD
     std::unique_ptr<RMSprop_mod<_type>> rms;                    // use the RMS optimizer for GD
+    std::unique_ptr<SRcg<_type>> cg;                            // use the matrix-free conjugate gradient for SR
+    std::unique_ptr<SRmin<_type>> minsr;                        // use the sample-space SR
+    std::unique_ptr<SRdense<_type>> dense;                      // use the dense SR with a chosen factorization
 
     // saved training parameters
-    u64 current_state;                                          // current state during the simulation
-    Col<double> current_vector;                                 // current state vector during the simulation
-    Col<double> tmp_vector;                                     // tmp state vector during the simulation
-    v_1d<Col<double>> tmp_vectors;                              // tmp vectors for omp 
+    v_1d<chain> chains;                                         // independent Markov chains, one or more per thread
     map<u64, _type> mostCommonStates;                           // save most common states energy to save the time
 
 
-    void rescale_covariance();                                  // 
+    double get_sr_shift() const;                                // diagonal shift of the covariance at the current step
 public:
     ~rbmState() = default;
     rbmState() = default;
     rbmState(size_t nH, size_t nV, std::shared_ptr<SpinHamiltonian<_hamtype>> const & hamiltonian,
-            double lr, size_t batch, size_t thread_num
+            double lr, size_t batch, size_t thread_num, size_t n_chains = 1,
+            impDef::sr_types sr_type = impDef::sr_types::dense,
+            impDef::sr_dense_solvers sr_dense = impDef::sr_dense_solvers::pinv,
+            bool sr_schedule = false
             ) 
             : n_hidden(nH), n_visible(nV)
             , lr(lr)
             , batch(batch)
             {
                 this->thread_num = thread_num;
+                this->n_chains = n_chains > 0 ? n_chains : 1;
+                this->sr_type = sr_type;
+                this->sr_schedule = sr_schedule;
+#ifdef USE_SR
+                if (this->sr_type == impDef::sr_types::dense)
+                    this->dense = std::make_unique<SRdense<_type>>(sr_dense);
+#endif
                 // checks for the debug info
                 this->debug_check();          
                 // creates the hamiltonian class
@@ -135,7 +355,8 @@ public:
                 this->initAv();
                 // initialize random state
                 this->init();
-                this->set_rand_state();
+                for (auto& ch : this->chains)
+                    this->set_rand_state(ch);
             };
     // -------------------------------------------				 HELPERS				 -------------------------------------------
     
@@ -179,76 +400,144 @@ public:
     // sets info
     void set_info()                                                     { this->info = VEQ(n_visible) + "," + VEQ(n_hidden) + "," + VEQ(batch) + "," + VEQ(lr); };
 
-    // sets the current state
-    void set_state(u64 state, bool set = false) {
-        this->current_state = state;
+    // sets the current state of the chain
+    void set_state(chain& ch, u64 state, bool set = false) {
+        ch.current_state = state;
 
-        INT_TO_BASE_BIT(state, this->current_vector);
+        INT_TO_BASE_BIT(state, ch.current_vector);
 
 #ifdef RBM_ANGLES_UPD
     if (set)
-        this->set_angles();
+        this->set_angles(ch);
 #endif
     }
     
-    // set the current state to random
-    void set_rand_state();
+    // set the current state of the chain to random
+    void set_rand_state(chain& ch);
     
     // set weights
     void set_weights();
 
+    // keep the chains between the iterations
+    void set_persistent(bool persistent)                                { this->persistent = persistent; };
+    // choose the Markov chain sampler
+    void set_sampler(impDef::sampler_types sampler)                     { this->sampler = sampler; };
+    // number of the walkers advanced in lockstep by each chain
+    void set_walkers(size_t n_walkers)                                  { this->n_walkers = std::max<size_t>(n_walkers, 1); };
+
     // set effective angles
-    void set_angles();
-    void set_angles(const Col<double>& v);
+    void set_angles(chain& ch);
     // ------------------------------------------- 				 UPDATERS				  -----------------------------------------
-    void update_angles(int flip_place, double flipped_spin);
-    void update_angles(const Col<double>& v, int flip_place);
+    void update_angles(chain& ch, int flip_place);
 
     // ------------------------------------------- 				 GETTERS				  ------------------------------------------
     auto get_info()                                                     const RETURNS(this->info);
     auto get_op_av()                                                    const RETURNS(this->op);
+    std::string get_sr_report() const {
+        switch (this->sr_type) {
+        case impDef::sr_types::cg:      return this->cg->report();
+        case impDef::sr_types::min_sr:  return this->minsr->report();
+        default:                        return this->dense->report();
+        }
+    };
 
     // ------------------------------------------- 				 INITIALIZERS				  ------------------------------------------
 
     // allocate the memory for the biases and weights
     void allocate();
+    void init_chains();
     // initialize all
     void init();
     void initAv();
     // ------------------------------------------- 				 AMPLITUDES AND ANSTATZ REPRESENTATION				  -------------------------------------------
 
-    // the hiperbolic cosine of the parameters
-    Col<_type> Fs(const Col<double>& v)                                 const { return arma::cosh(this->b_h + this->W * v); };
+    // the effective angles of the hidden neurons
+    Col<_type> angles(const Col<double>& v)                             const { return this->b_h + this->W * v; };
+    
+    // the logarithm of the hiperbolic cosine of the angles
+    Col<_type> logFs(const Col<double>& v)                              const { return logCoshV(this->angles(v)); };
+
+    // get the logarithm of the amplitude given vector (without the normalisation)
+    _type log_psi(const Col<double>& v, int tn = 1)                     const { return dotm(this->b_v, v, tn) + arma::sum(this->logFs(v)); };
+
+    // get the logarithms of the amplitudes for the vectors stored in columns - single GEMM for all of them
+    Col<_type> log_psi(const Mat<double>& V) const;
 
     // get the current amplitude given vector
-    auto coeff(const Col<double>& v, int tn = 1)                        const { return (exp(dotm(this->b_v, v, tn)) * arma::prod(Fs(v))) / sqrt(this->hamil->lattice->get_Ns()); };//* std::pow(2.0, this->n_hidden)
+    auto coeff(const Col<double>& v, int tn = 1)                        const { return exp(this->log_psi(v, tn)) / sqrt(this->hamil->lattice->get_Ns()); };//* std::pow(2.0, this->n_hidden)
+
+    // get logarithm of the probability ratio for a reference state v1 and v2 state
+    _type log_ratio(const chain& ch, const Col<double>& v, int tn = 1) const { return dotm(this->b_v, Col<double>(v - ch.current_vector), tn) + arma::sum(this->logFs(v) - logCoshV(ch.thetas)); };
+    _type log_ratio(const Col<double>& v1, const Col<double>& v2\
+        , int tn = 1)                                                   const { return dotm(this->b_v, Col<double>(v2 - v1), tn) + arma::sum(this->logFs(v2) - this->logFs(v1)); };
+
+    // get logarithm of the probability ratio for one or two flips of the current state of the chain - uses the cached angles
+    _type log_ratio(const chain& ch, int flip_place) const;
+    _type log_ratio(const chain& ch, int flip_place_1, int flip_place_2) const;
+    void log_ratios_flips(const chain& ch, Col<_type>& out) const;
+    Row<_type> log_cosh_shifts(const Col<_type>& thetas, const Row<_type>& deltas, uword first = 0) const;
+    _type log_ratio_proposal(chain& ch, int flip_place) const;
 
     // get probability ratio for a reference state v1 and v2 state
-    _type pRatio(int tn = 1)                                            const { return exp(dotm(this->b_v, Col<double>(this->tmp_vector - this->current_vector), tn) + sum(log(Fs(this->tmp_vector) / Fs(this->current_vector)))); };
-    _type pRatio(const Col<double>& v, int tn = 1)                      const { return exp(dotm(this->b_v, Col<double>(v - this->current_vector), tn) + arma::sum(log(Fs(v) / arma::cosh(this->thetas)))); };
+    _type pRatio(const chain& ch, const Col<double>& v, int tn = 1)    const { return exp(this->log_ratio(ch, v, tn)); };
     _type pRatio(const Col<double>& v1, const Col<double>& v2\
-        , int tn = 1)                                                   const { return exp(dotm(this->b_v, Col<double>(v2 - v1), tn) + sum(log(Fs(v2) / Fs(v1)))); };
+        , int tn = 1)                                                   const { return exp(this->log_ratio(v1, v2, tn)); };
+
+    // get probability ratio for one or two flips of the current state of the chain - uses the cached angles
+    _type pRatio(const chain& ch, int flip_place)                      const { return exp(this->log_ratio(ch, flip_place)); };
+    _type pRatio(const chain& ch, int flip_place_1, int flip_place_2)  const { return exp(this->log_ratio(ch, flip_place_1, flip_place_2)); };
+
+    // value of the visible neuron read from the packed state
+    double visible(u64 state, int place)                               const {
+#ifdef SPIN
+        return checkBit(state, this->n_visible - 1 - place) ? 1.0 : -1.0;
+#else
+        return checkBit(state, this->n_visible - 1 - place) ? 1.0 : 0.0;
+#endif
+    };
+    // bit mask of the visible neuron in the packed state
+    u64 visibleMask(int place)                                         const { return u64(1) << (this->n_visible - 1 - place); };
+
+    // change of the visible neuron value when flipped at a given place
+    double flipDelta(const chain& ch, int flip_place)                  const {
+#ifdef SPIN
+        return -2.0 * this->visible(ch.current_state, flip_place);
+#else
+        return 1.0 - 2.0 * this->visible(ch.current_state, flip_place);
+#endif
+    };
 
     // get local energies
-    _type locEn();
-    _type pRatioValChange(_type v, u64 state);
+    _type locEn(chain& ch);
+    void locEn(const v_1d<u64>& states, Col<_type>& energies);
+    _type pRatioValChange(const chain& ch, _type v, u64 state, Col<double>& tmp) const;
 
     // variational derivative calculation
-    void calcVarDeriv(const Col<double>& v);
+    void calcVarDeriv(chain& ch);
 
     // update weights after gradient descent
-    void updVarDerivSR(int current_step);
+    void updVarDerivSR(int current_step, const Col<_type>& energies);
     // ------------------------------------------- 				 SAMPLING				  -------------------------------------------
     
     // sample block
-    void blockSampling(size_t b_size, u64 start_stae, size_t n_flips = 1, bool thermalize = true, bool update = false);
+    void blockSampling(chain& ch, size_t b_size, size_t n_flips = 1);
+    void rejectionFreeSampling(chain& ch, double time);
+
+    // lockstep walkers of the chain
+    void set_walker_angles(chain& ch);
+    void walkerSampling(chain& ch, size_t b_size);
+    void thermalizeWalkers(chain& ch, size_t n_therm, size_t b_size);
+    void load_walker(chain& ch, size_t w);
+
+    // restart or re-equilibrate the chain
+    void thermalize(chain& ch, size_t n_therm, size_t b_size, size_t n_flips = 1);
 
     // sample the probabilistic space
     Col<_type> mcSampling(size_t n_samples, size_t n_blocks, size_t n_therm, size_t b_size, size_t n_flips = 1);
 
 
     // average collection
-    void collectAv(_type loc_en);
+    void collectAv(chain& ch, _type loc_en);
     map<u64, _type> avSampling(size_t n_samples, size_t n_blocks, size_t n_therm, size_t b_size, size_t n_flips = 1);
 
 };
@@ -290,19 +579,33 @@ void rbmState<_type, _hamtype>::allocate() {
     this->b_v = Col<_type>(this->n_visible, arma::fill::randn) / double(Ns);
     this->b_h = Col<_type>(this->n_hidden, arma::fill::randn) / double(Ns);
     this->W = Mat<_type>(this->n_hidden, this->n_visible, arma::fill::randn) / double(Ns);
-    // allocate gradients
-    this->O_flat = Col<_type>(this->full_size, arma::fill::zeros);
-    this->thetas = Col<_type>(this->n_hidden, arma::fill::zeros);
 
     // allocate covariance and forces
     this->F = Col<_type>(this->full_size, arma::fill::zeros);
 #ifdef USE_SR
-    this->S = Mat<_type>(this->full_size, this->full_size, arma::fill::zeros);
+    // the dense covariance is only needed when it is inverted directly
+    if (this->sr_type == impDef::sr_types::dense)
+        this->S = Mat<_type>(this->full_size, this->full_size, arma::fill::zeros);
+    else if (this->sr_type == impDef::sr_types::cg)
+        this->cg = std::make_unique<SRcg<_type>>(this->full_size);
+    else
+        this->minsr = std::make_unique<SRmin<_type>>();
 #endif
-    // allocate vectors
-    this->current_vector = Col<double>(this->n_visible, arma::fill::ones);
-    this->tmp_vector = Col<double>(this->n_visible, arma::fill::ones);
-    this->tmp_vectors = v_1d<Col<double>>(this->thread_num, Col<double>(this->n_visible, arma::fill::ones));
+    // allocate the chains
+    this->init_chains();
+}
+
+/*
+* @brief creates the Markov chains, each with its own random stream seeded from the Hamiltonian generator
+*/
+template<typename _type, typename _hamtype>
+void rbmState<_type, _hamtype>::init_chains() {
+    this->chains.clear();
+    this->chains.reserve(this->n_chains);
+    for (auto c = 0; c < this->n_chains; c++) {
+        this->chains.emplace_back(this->n_visible, this->n_hidden, this->hamil->ran.randomInt_uni(0, INT_MAX));
+        this->chains.back().loc_energies = this->hamil->get_loc_en_workspace();
+    }
 }
 
 /*
@@ -310,8 +613,6 @@ void rbmState<_type, _hamtype>::allocate() {
 */
 template<typename _type, typename _hamtype>
 void rbmState<_type, _hamtype>::init() {
-    // initialize random state
-    this->set_rand_state();
 
     // initialize biases visible
     for (int i = 0; i < this->n_visible; i++)
@@ -330,8 +631,6 @@ void rbmState<_type, _hamtype>::init() {
 */
 template<>
 inline void rbmState<cpx, double>::init() {
-    // initialize random state
-    this->set_rand_state();
     auto Ns = this->hamil->lattice->get_Ns();
     // initialize biases visible
     for (int i = 0; i < this->n_visible; i++)
@@ -356,8 +655,6 @@ inline void rbmState<cpx, double>::init() {
 */
 template<>
 inline void rbmState<cpx, cpx>::init() {
-    // initialize random state
-    this->set_rand_state();
     auto Ns = this->hamil->lattice->get_Ns();
     // initialize biases visible
     for (int i = 0; i < this->n_visible; i++)
@@ -392,68 +689,45 @@ inline void rbmState<_type, _hamtype>::initAv()
 
 // ------------------------------------------------- 				 UPDATERS				  ------------------------------------------------
 
-/*
-* @brief update angles with the flipped spin (before the flip - hence -)
-* @param flip_place place of the flip
-* @param flipped_spin spin that would be flipped
-*/
-template<typename _type, typename _hamtype>
-inline void rbmState<_type, _hamtype>::update_angles(int flip_place, double flipped_spin)
-{
-#ifdef SPIN
-    //this->thetas -= (2.0 * flipped_spin) * this->W.col(flip_place);
-    setConstTimesCol(this->thetas, (2.0 * flipped_spin), this->W.col(flip_place), false, false);
-#else
-    //this->thetas += (1.0 - 2.0 * flipped_spin) * this->W.col(flip_place);
-    setConstTimesCol(this->thetas, (1.0 - 2.0 * flipped_spin), this->W.col(flip_place), true, false);
-#endif
-} 
-
 /*
 * @brief update angles with the vector (after the flip - hence +)
-* @param v vector after flip
+* @param ch chain whose angles are updated
 * @param flip_place place of the flip
 */
 template<typename _type, typename _hamtype>
-inline void rbmState<_type, _hamtype>::update_angles(const Col<double>& v, int flip_place)
+inline void rbmState<_type, _hamtype>::update_angles(chain& ch, int flip_place)
 {
 #ifdef SPIN
-    //this->thetas += (2.0 * v(flip_place)) * this->W.col(flip_place);
-    setConstTimesCol(this->thetas, (2.0 * v(flip_place)), this->W.col(flip_place), true, false);
+    //ch.thetas += (2.0 * v(flip_place)) * this->W.col(flip_place);
+    setConstTimesCol(ch.thetas, (2.0 * this->visible(ch.current_state, flip_place)), this->W.col(flip_place), true, false);
 #else
-    //this->thetas -= (1.0 - 2.0 * v(flip_place)) * this->W.col(flip_place);
-    setConstTimesCol(this->thetas, (1.0 - 2.0 * v(flip_place)), this->W.col(flip_place), false, false);
+    //ch.thetas -= (1.0 - 2.0 * v(flip_place)) * this->W.col(flip_place);
+    setConstTimesCol(ch.thetas, (1.0 - 2.0 * this->visible(ch.current_state, flip_place)), this->W.col(flip_place), false, false);
 #endif
 }
 
 // -------------------------------------------------				  SETTERS				  -------------------------------------------------
 
 /*
-* @brief sets the current state to uniform random
+* @brief sets the current state of the chain to uniform random
+* @param ch chain to be set
 */
 template<typename _type, typename _hamtype>
-inline void rbmState<_type, _hamtype>::set_rand_state()
+inline void rbmState<_type, _hamtype>::set_rand_state(chain& ch)
 { 
-    this->set_state(this->hamil->ran.randomInt_uni(0, this->hilbert_size), true); 
-}
-
-/*
-* @brief sets the current angles vector according to arXiv:1606.02318v1
-*/
-template<typename _type, typename _hamtype>
-inline void rbmState<_type, _hamtype>::set_angles()
-{
-    this->thetas = this->b_h + this->W * this->current_vector;
+    this->set_state(ch, ch.ran.randomInt_uni(0, this->hilbert_size), true); 
 }
 
 /*
-* @brief sets the current angles vector according to arXiv:1606.02318v1
-* @param v replaces current vector
+* @brief sets the current angles vector according to arXiv:1606.02318v1. The visible vector is materialised from
+* the packed state only here, where the product with W needs it.
+* @param ch chain whose angles are set from its current state
 */
 template<typename _type, typename _hamtype>
-inline void rbmState<_type, _hamtype>::set_angles(const Col<double>& v)
+inline void rbmState<_type, _hamtype>::set_angles(chain& ch)
 {
-    this->thetas = this->b_h + this->W * v;
+    INT_TO_BASE_BIT(ch.current_state, ch.current_vector);
+    ch.thetas = this->b_h + this->W * ch.current_vector;
 }
 
 /*
@@ -480,66 +754,58 @@ void rbmState<_type, _hamtype>::set_weights() {
 }
 // ------------------------------------------------- 				 CALCULATORS				  -------------------------------------------------
 
+/*
+* @brief diagonal shift of the covariance matrix - decays with the Monte Carlo steps when the schedule is used
+*/
 template<typename _type, typename _hamtype>
-inline void rbmState<_type, _hamtype>::rescale_covariance()
+inline double rbmState<_type, _hamtype>::get_sr_shift() const
 {
-    auto lambda_p = lambda_0_reg * this->current_b_reg;
-    //stout << VEQ(lambda_p) << EL;
-    if (lambda_p < lambda_min_reg) lambda_p = lambda_min_reg;
-    this->S.diag() += lambda_p;
+    if (!this->sr_schedule)
+        return lambda_min_reg;
+    return std::max(lambda_0_reg * this->current_b_reg, lambda_min_reg);
 }
 
 /*
-* @brief calculates the variational derivative analytically
-* @param v the base vector we want to calculate derivatives from
+* @brief calculates the variational derivative analytically. Only the hidden part tanh(theta) is computed,
+* the visible part is the state vector and the weights part is their outer product (see rbmDerivatives)
+* @param ch the chain we want to calculate derivatives from (its current vector)
 */
 template<typename _type, typename _hamtype>
-void rbmState<_type, _hamtype>::calcVarDeriv(const Col<double>& v){
+void rbmState<_type, _hamtype>::calcVarDeriv(chain& ch){
     auto var_deriv_time = std::chrono::high_resolution_clock::now();
-
 #ifndef RBM_ANGLES_UPD
-    this->set_angles(v);
+    this->set_angles(ch);
 #endif
-    // calculate the flattened part
-#pragma omp parallel for
-    for (auto i = 0; i < this->n_visible; i++)
-        this->O_flat(i) = v(i);
-#pragma omp parallel for
-    for (auto i = 0; i < this->n_hidden; i++) {
-        const auto elem = i + this->n_visible;
-        this->O_flat(elem) = std::tanh(this->thetas(i));
-    }
-#pragma omp parallel for
-    for (auto i = 0; i < this->n_hidden; i++) {
-        for (auto j = 0; j < this->n_visible; j++) {
-            const auto elem = (this->n_visible + this->n_hidden) + i + j * this->n_hidden;
-            const auto elem_hidden = i + this->n_visible;
-            this->O_flat(elem) = this->O_flat(elem_hidden) * v(j);
-        }
-    }
+    ch.tanh_thetas = arma::tanh(ch.thetas);
     PRT(var_deriv_time, this->dbg_drvt)
 }
 
 /*
 * @brief updates the weights using stochastic gradient descent
 * @param current_step if we would like to optimize according to current mcstep
+* @param energies local energies of the samples, used by the sample-space solution
 */
 template<typename _type, typename _hamtype>
-void rbmState<_type, _hamtype>::updVarDerivSR(int current_step){
+void rbmState<_type, _hamtype>::updVarDerivSR(int current_step, const Col<_type>& energies){
     auto var_deriv_time_upd = std::chrono::high_resolution_clock::now();
    
-    // update flat vector
-#ifdef PINV
-    this->F = this->lr * arma::pinv(this->S, pinv_tol, "std") * this->F;
-    //else
-    //    this->grad = this->lr * arma::solve(this->S, this->F);
-#elif defined S_REGULAR 
-    this->rescale_covariance();
-    //auto lr_new = this->hamil->ran.randomReal_uni(0, 1) * 3 * this->lr;
-    this->F = this->lr * S.i() * this->F;//arma::solve(this->S, this->F);
-#else 
-    this->F = this->lr * arma::solve(this->S, this->F);
-#endif 
+    const auto shift = this->get_sr_shift();
+    switch (this->sr_type) {
+    case impDef::sr_types::cg:
+        // matrix-free solution with the centered derivatives
+        this->cg->set_shift(shift);
+        this->F = this->lr * this->cg->solve(this->derivatives, this->F);
+        break;
+    case impDef::sr_types::min_sr:
+        // sample-space solution with the centered derivatives
+        this->minsr->set_shift(shift);
+        this->F = this->lr * this->minsr->solve(this->derivatives, energies);
+        break;
+    default:
+        // factorization of the dense covariance
+        this->F = this->lr * this->dense->solve(this->S, this->F, shift);
+        break;
+    }
     PRT(var_deriv_time_upd, this->dbg_updt);
 }
 
@@ -548,105 +814,482 @@ void rbmState<_type, _hamtype>::updVarDerivSR(int current_step){
 
 
 /*
-* 
+* @brief logarithm of the probability ratio of the state with a single flip to the current state of the chain,
+* uses the cached angles and a single column of W so it costs O(n_hidden)
+* @param ch chain holding the reference state and its angles
+* @param flip_place place of the flip
 */
 template<typename _type, typename _hamtype>
-inline _type rbmState<_type, _hamtype>::pRatioValChange(_type v, u64 state)
+inline _type rbmState<_type, _hamtype>::log_ratio(const chain& ch, int flip_place) const
 {
-#ifndef DEBUG
-        //const int tid = std::hash<std::thread::id>{}(std::this_thread::get_id());
-        //const int vid = tid % this->thread_num;
-        const int vid = omp_get_thread_num() % this->thread_num;
-#else
-        const int vid = 0;
-#endif
-        INT_TO_BASE_BIT(state, this->tmp_vectors[vid]);
-#ifndef RBM_ANGLES_UPD
-        return v * this->pRatio(this->current_vector, this->tmp_vectors[vid]);
-#else
-        return v * this->pRatio(this->tmp_vectors[vid]);
-#endif
+    const double d = this->flipDelta(ch, flip_place);
+    _type val = d * this->b_v(flip_place);
+    for (auto i = 0; i < this->n_hidden; i++)
+        val += logCosh(_type(ch.thetas(i) + d * this->W(i, flip_place))) - logCosh(ch.thetas(i));
+    return val;
+}
+
+/*
+* @brief logarithm of the probability ratio of the state with two flips to the current state of the chain,
+* uses the cached angles and two columns of W so it costs O(n_hidden)
+* @param ch chain holding the reference state and its angles
+* @param flip_place_1 place of the first flip
+* @param flip_place_2 place of the second flip
+*/
+template<typename _type, typename _hamtype>
+inline _type rbmState<_type, _hamtype>::log_ratio(const chain& ch, int flip_place_1, int flip_place_2) const
+{
+    const double d1 = this->flipDelta(ch, flip_place_1);
+    const double d2 = this->flipDelta(ch, flip_place_2);
+    _type val = d1 * this->b_v(flip_place_1) + d2 * this->b_v(flip_place_2);
+    for (auto i = 0; i < this->n_hidden; i++)
+        val += logCosh(_type(ch.thetas(i) + d1 * this->W(i, flip_place_1) + d2 * this->W(i, flip_place_2))) - logCosh(ch.thetas(i));
+    return val;
+}
+
+/*
+* @brief logarithm of the probability ratio of the proposed single flip, which keeps the angles of the proposed state
+* and their log cosh in the chain. The accepted move swaps them in, so the column of W is read once per proposal and
+* the log cosh of the current angles is not recomputed. Needs the log cosh of the current angles in the chain.
+* @param ch chain holding the reference state, its angles and the proposal buffers
+* @param flip_place place of the flip
+*/
+template<typename _type, typename _hamtype>
+inline _type rbmState<_type, _hamtype>::log_ratio_proposal(chain& ch, int flip_place) const
+{
+    const double d = this->flipDelta(ch, flip_place);
+    const _type* w = this->W.colptr(flip_place);
+    _type val = d * this->b_v(flip_place);
+    for (auto i = 0; i < this->n_hidden; i++) {
+        ch.proposed_thetas(i) = ch.thetas(i) + d * w[i];
+        ch.proposed_log_cosh(i) = logCosh(ch.proposed_thetas(i));
+        val += ch.proposed_log_cosh(i) - ch.log_cosh_thetas(i);
+    }
+    return val;
+}
+
+/*
+* @brief logarithms of the hidden parts sum_h log(cosh(theta_h + a_hf) / cosh(theta_h)) of the ratios of the single flips
+* f = first, ..., n_visible - 1 with a_f = d_f W(:, f). The n_hidden x flips shifted angles are built as a whole matrix
+* and each factor stays in the log domain, so the saturated tanh(theta) of the large angles loses no accuracy.
+* @param thetas angles of the reference state
+* @param deltas changes of all the visible neurons
+* @param first first flip place
+*/
+template<typename _type, typename _hamtype>
+inline Row<_type> rbmState<_type, _hamtype>::log_cosh_shifts(const Col<_type>& thetas, const Row<_type>& deltas, uword first) const
+{
+    Mat<_type> shifted = this->W.cols(first, this->n_visible - 1);
+    shifted.each_row() %= deltas.cols(first, this->n_visible - 1);
+    shifted.each_col() += thetas;
+    shifted.transform([](_type x) { return logCosh(x); });
+    return arma::sum(shifted, 0) - arma::accu(logCoshV(thetas));
+}
+
+/*
+* @brief logarithms of the probability ratios of all the single flips of the current state of the chain at once.
+* Every hidden unit gives log cosh(theta + a_f) - log cosh(theta) with a_f = d_f W(:, f), evaluated over the whole
+* matrix of the flips instead of a loop over them. Uses the cached angles, O(n_hidden n_visible).
+* @param ch chain holding the reference state and its angles
+* @param out logarithms of the ratios for every flip place
+*/
+template<typename _type, typename _hamtype>
+inline void rbmState<_type, _hamtype>::log_ratios_flips(const chain& ch, Col<_type>& out) const
+{
+    Row<_type> deltas(this->n_visible);
+    for (auto f = 0; f < this->n_visible; f++)
+        deltas(f) = this->flipDelta(ch, f);
+    out = (deltas.st() % this->b_v) + this->log_cosh_shifts(ch.thetas, deltas).st();
+}
+
+/*
+* @brief calculates the value times the probability ratio of the given state to the current state of the chain.
+* States differing by one or two flips use the cached angles, the others are decoded and computed from scratch.
+* The angles of the chain must match its current state.
+* @param ch chain holding the reference state
+* @param v value to multiply by
+* @param state state to calculate the ratio for
+* @param tmp caller owned vector used to decode the state
+*/
+template<typename _type, typename _hamtype>
+inline _type rbmState<_type, _hamtype>::pRatioValChange(const chain& ch, _type v, u64 state, Col<double>& tmp) const
+{
+    const u64 diff = state ^ ch.current_state;
+    // vector place of the lowest set bit
+    auto place = [&](u64 n) { return int(this->n_visible) - 1 - std::countr_zero(n); };
+    switch (std::popcount(diff)) {
+    case 0:
+        return v;
+    case 1:
+        return v * this->pRatio(ch, place(diff));
+    case 2:
+        return v * this->pRatio(ch, place(diff), place(diff & (diff - 1)));
+    default:
+        INT_TO_BASE_BIT(state, tmp);
+        return v * this->pRatio(ch, tmp);
+    }
 }
 
 
 /*
 * @brief Calculate the local energy depending on the given Hamiltonian
+* @param ch chain at which state the local energy is calculated
 */
 template<typename _type, typename _hamtype>
-inline _type rbmState<_type, _hamtype>::locEn(){
+inline _type rbmState<_type, _hamtype>::locEn(chain& ch){
     auto loc_en_time = std::chrono::high_resolution_clock::now();
     const auto hilb = this->hamil->get_hilbert_size();
+#ifndef RBM_ANGLES_UPD
+    // the connected states ratios use the angles of the current state
+    this->set_angles(ch);
+#endif
+
+    // each chain owns its buffer so the chains do not need to synchronize
+    this->hamil->locEnergy(ch.current_state, ch.loc_energies);
+
+    // the single flips (transverse fields) share the kernel of all the flips
+    size_t n_single = 0;
+    for (const auto& [state, value] : ch.loc_energies)
+        n_single += state < hilb && std::popcount(state ^ ch.current_state) == 1;
+    const bool all_flips = n_single > 1;
+    if (all_flips)
+        this->log_ratios_flips(ch, ch.flip_log_ratios);
 
-    this->hamil->locEnergy(this->current_state);
     _type energy = 0;
-#ifndef DEBUG
-#pragma omp parallel for reduction(+ : energy)
-#endif
-    for (auto i = 0; i < this->hamil->get_loc_states_num(); i++)
+    for (const auto& [state, value] : ch.loc_energies)
     {
-        const auto [state, value] = this->hamil->get_loc_state_at(i);
-
-        //stout << state << "\t" << value << EL;
         // if the state is not set
         if (state >= hilb)
             continue;
+        const u64 diff = state ^ ch.current_state;
+        if (all_flips && std::popcount(diff) == 1)
+            energy += _type(value) * std::exp(ch.flip_log_ratios(this->n_visible - 1 - std::countr_zero(diff)));
+        else
+            energy += diff != 0 ? this->pRatioValChange(ch, value, state, ch.tmp_vector) : value;
+    }
+    PRT(loc_en_time, this->dbg_lcen);
+    return energy;
+}
 
-        // changes accordingly not to create data race
-        energy += state != this->current_state ? this->pRatioValChange(value, state) : value;
+/*
+* @brief calculates the logarithms of the amplitudes (without the normalisation) of many vectors at once.
+* The angles of all the vectors are obtained with a single matrix-matrix product.
+* @param V matrix with the vectors stored in columns
+*/
+template<typename _type, typename _hamtype>
+inline Col<_type> rbmState<_type, _hamtype>::log_psi(const Mat<double>& V) const
+{
+    Mat<_type> thetas = this->W * V;
+    thetas.each_col() += this->b_h;
+    thetas.transform([](_type x) { return logCosh(x); });
+    return V.t() * this->b_v + arma::sum(thetas, 0).st();
+}
+
+/*
+* @brief Calculate the local energies of many sampled states at once. The connected states of all samples are
+* collected into matrices and their amplitudes are evaluated with a few large GEMMs instead of one GEMV per state.
+* @param states sampled states
+* @param energies vector to be filled with the local energies of the samples
+*/
+template<typename _type, typename _hamtype>
+inline void rbmState<_type, _hamtype>::locEn(const v_1d<u64>& states, Col<_type>& energies)
+{
+    auto loc_en_time = std::chrono::high_resolution_clock::now();
+    const auto hilb = this->hamil->get_hilbert_size();
+    const auto n_states = states.size();
+    energies.zeros(n_states);
+
+    // collect the connected states, diagonal parts are added directly
+    v_1d<u64> conn_states;
+    v_1d<_hamtype> conn_values;
+    v_1d<size_t> owners;
+    auto ws = this->hamil->get_loc_en_workspace();
+    for (auto k = 0; k < n_states; k++) {
+        this->hamil->locEnergy(states[k], ws);
+        for (const auto& [state, value] : ws) {
+            // if the state is not set
+            if (state >= hilb)
+                continue;
+            if (state == states[k])
+                energies(k) += value;
+            else {
+                conn_states.push_back(state);
+                conn_values.push_back(value);
+                owners.push_back(k);
+            }
+        }
+    }
 
-        // reset local energies
-        this->hamil->set_loc_en_elem(i, LLONG_MAX, 0.0);
+    // amplitudes of the samples
+    Col<double> tmp(this->n_visible, arma::fill::ones);
+    Mat<double> V(this->n_visible, n_states);
+    for (auto k = 0; k < n_states; k++) {
+        INT_TO_BASE_BIT(states[k], tmp);
+        V.col(k) = tmp;
+    }
+    const Col<_type> log_samples = this->log_psi(V);
+
+    // amplitudes of the connected states in chunks
+    for (size_t start = 0; start < conn_states.size(); start += loc_en_batch_cols) {
+        const auto end = std::min(start + loc_en_batch_cols, conn_states.size());
+        V.set_size(this->n_visible, end - start);
+        for (auto m = start; m < end; m++) {
+            INT_TO_BASE_BIT(conn_states[m], tmp);
+            V.col(m - start) = tmp;
+        }
+        const Col<_type> log_conn = this->log_psi(V);
+        for (auto m = start; m < end; m++)
+            energies(owners[m]) += _type(conn_values[m]) * std::exp(log_conn(m - start) - log_samples(owners[m]));
     }
     PRT(loc_en_time, this->dbg_lcen);
-    return energy;
 }
 
 // ------------------------------------------------- SAMPLING -------------------------------------------------
 
 /*
-* @brief block updates the current state according to Metropolis-Hastings algorithm
+* @brief block updates the current state of the chain according to Metropolis-Hastings algorithm. Without the angles
+* updates between the blocks the angles are set once per block and then updated with the accepted flips, while the
+* ratio of a proposed flip is computed only when it is proposed and is cached until the state changes.
+* @param ch chain to be updated
 * @param b_size the size of the correlation block
-* @param start_state the state to start from
 * @param n_flips number of flips at the single step
 */
 template<typename _type, typename _hamtype>
-void rbmState<_type, _hamtype>::blockSampling(size_t b_size, u64 start_state, size_t n_flips, bool thermalize, bool update){
-    if(start_state != this->current_state)
-        this->set_state(start_state, thermalize);
-
-    // set the tmp_vector to current state
-    this->tmp_vector = this->current_vector;
+void rbmState<_type, _hamtype>::blockSampling(chain& ch, size_t b_size, size_t n_flips){
+    if (this->sampler == impDef::sampler_types::rejection_free) {
+        this->rejectionFreeSampling(ch, double(b_size));
+        return;
+    }
+#ifdef RBM_ANGLES_UPD
+    ch.log_cosh_thetas = logCoshV(ch.thetas);
+#else
+    this->set_angles(ch);
+    // invalidates the ratios cached by the previous blocks
+    ch.stamp++;
+#endif
 
     for(auto i = 0; i < b_size; i++){
 
-        const int flip_place = this->hamil->ran.randomInt_uni(0, this->n_visible);
-        const double flip_spin = this->tmp_vector(flip_place);
-
-        flipV(this->tmp_vector, flip_place);
+        const int flip_place = ch.ran.randomInt_uni(0, this->n_visible);
 
+        // acceptance in the log domain - log(u) <= log(|psi'/psi|^2)
         #ifndef RBM_ANGLES_UPD
-        double proba = abs(this->pRatio(this->current_vector, this->tmp_vector, this->thread_num));
+        // the ratio of the flip is computed once per visited state, O(n_hidden)
+        if (ch.flip_stamps[flip_place] != ch.stamp) {
+            ch.flip_log_ratios(flip_place) = this->log_ratio(ch, flip_place);
+            ch.flip_stamps[flip_place] = ch.stamp;
+        }
+        const double log_proba = std::real(ch.flip_log_ratios(flip_place));
         #else
-        double proba = abs(this->pRatio(this->tmp_vector, this->thread_num));
-        //stout << VEQ(proba) << EL;
+        const double log_proba = std::real(this->log_ratio_proposal(ch, flip_place));
         #endif
-        if (this->hamil->ran.randomReal_uni() <= proba * proba ){//
-            // update current state and vector
+        if (std::log(ch.ran.randomReal_uni()) <= 2.0 * log_proba){
+            // update the packed state, the vector is materialised only when needed
+            ch.current_state ^= this->visibleMask(flip_place);
 
-            this->current_vector(flip_place) = this->tmp_vector(flip_place);
-
-            // update angles if needed
+            // update angles if needed - the proposal already holds them
             #ifdef RBM_ANGLES_UPD
-            this->update_angles(this->current_vector, flip_place);
+            ch.thetas.swap(ch.proposed_thetas);
+            ch.log_cosh_thetas.swap(ch.proposed_log_cosh);
+            #else
+            this->update_angles(ch, flip_place);
+            ch.stamp++;
             #endif
         }
-        else {
-            // set the vector back to normal
-            this->tmp_vector(flip_place) = flip_spin;
+    }
+    // the vector for the derivatives and the amplitudes of the block
+    INT_TO_BASE_BIT(ch.current_state, ch.current_vector);
+}
+
+/*
+* @brief Rejection-free (continuous time, n-fold way) evolution of the chain. The Metropolis single flip moves become
+* the rates w_f = min(1, |psi(s^f) / psi(s)|^2) / n_visible, so one unit of time is a single Metropolis proposal.
+* The chain stays in s for the exponentially distributed residence time with the total rate W = sum_f w_f and then
+* always flips f with the probability w_f / W. The state returned is the one occupied at the given time, so the
+* samples taken at the equal time intervals are already weighted by their residence times and need no reweighting.
+* The angles after every single flip, theta + a_g with a_g = d_g W(:, g), are kept as columns. The accepted flip f
+* shifts all of them by a_f and turns its own column back into theta, so the rates are updated from the angle shift
+* of the accepted flip without any product with W - only their log cosh is evaluated again, as every rate depends
+* on every angle. One event thus costs n_hidden * n_visible log cosh against n_hidden of a Metropolis proposal, and
+* it replaces about 1 / acceptance proposals - the sampler is faster only for the acceptance below about 1 / n_visible.
+* The walkers of walkerSampling always use the Metropolis sweeps, so it is used with a single walker only.
+* @param ch chain to be evolved
+* @param time length of the evolution in the Metropolis proposals
+*/
+template<typename _type, typename _hamtype>
+inline void rbmState<_type, _hamtype>::rejectionFreeSampling(chain& ch, double time)
+{
+    Col<double> rates(this->n_visible);
+    Row<_type> deltas(this->n_visible);
+#ifndef RBM_ANGLES_UPD
+    this->set_angles(ch);
+#endif
+    for (auto f = 0; f < this->n_visible; f++)
+        deltas(f) = this->flipDelta(ch, f);
+    ch.flip_thetas = this->W;
+    ch.flip_thetas.each_row() %= deltas;
+    ch.flip_thetas.each_col() += ch.thetas;
+    Mat<_type> log_cosh(this->n_hidden, this->n_visible);
+
+    double t = 0;
+    while (true) {
+        log_cosh = ch.flip_thetas;
+        log_cosh.transform([](_type x) { return logCosh(x); });
+        const Row<_type> log_ratios = deltas % this->b_v.st() + arma::sum(log_cosh, 0) - arma::accu(logCoshV(ch.thetas));
+        for (auto f = 0; f < this->n_visible; f++)
+            rates(f) = std::min(1.0, std::exp(2.0 * std::real(log_ratios(f))));
+        const Col<double> cumulative = arma::cumsum(rates);
+        const double total = cumulative(this->n_visible - 1) / double(this->n_visible);
+        if (total <= 0)
+            break;
+        // residence time in the current state
+        t -= std::log(1.0 - ch.ran.randomReal_uni()) / total;
+        if (t >= time)
+            break;
+        // flip chosen proportionally to its rate
+        const double target = ch.ran.randomReal_uni() * cumulative(this->n_visible - 1);
+        const int flip_place = std::min<int>(int(std::upper_bound(cumulative.begin(), cumulative.end(), target) - cumulative.begin()), int(this->n_visible) - 1);
+
+        // the accepted flip shifts all the angles by a_f and reverses its own shift
+        const Col<_type> shift = ch.flip_thetas.col(flip_place) - ch.thetas;
+        ch.flip_thetas.each_col() += shift;
+        ch.flip_thetas.col(flip_place) = ch.thetas;
+        ch.thetas += shift;
+        deltas(flip_place) = -deltas(flip_place);
+        ch.current_state ^= this->visibleMask(flip_place);
+    }
+    INT_TO_BASE_BIT(ch.current_state, ch.current_vector);
+}
+
+/*
+* @brief sets the angles of all the walkers of the chain with a single GEMM and their log cosh, the configurations
+* are unpacked only for the product
+*/
+template<typename _type, typename _hamtype>
+inline void rbmState<_type, _hamtype>::set_walker_angles(chain& ch)
+{
+    auto& wk = ch.walkers;
+    Mat<double> V(this->n_visible, wk.size());
+    for (size_t w = 0; w < wk.size(); w++) {
+        INT_TO_BASE_BIT(wk.states[w], ch.tmp_vector);
+        V.col(w) = ch.tmp_vector;
+    }
+    wk.Th = this->W * V;
+    wk.Th.each_col() += this->b_h;
+    wk.LC = wk.Th;
+    wk.LC.transform([](_type x) { return logCosh(x); });
+}
+
+/*
+* @brief Metropolis single flip sampling of all the walkers of the chain in lockstep. At every step each walker
+* proposes its own flip f_w with d_w, the proposed angles of all the walkers Th + W(:, f) diag(d) and their log cosh
+* are computed as whole matrices and the accepted walkers copy their columns in, so the walkers never recompute
+* their angles from scratch.
+* @param ch chain owning the walkers
+* @param b_size number of the steps
+*/
+template<typename _type, typename _hamtype>
+inline void rbmState<_type, _hamtype>::walkerSampling(chain& ch, size_t b_size)
+{
+    auto& wk = ch.walkers;
+    const size_t nw = wk.size();
+    arma::uvec places(nw);
+    Row<_type> deltas(nw);
+    Mat<_type> proposed(this->n_hidden, nw), proposed_lc(this->n_hidden, nw);
+    for (auto i = 0; i < b_size; i++) {
+        for (size_t w = 0; w < nw; w++) {
+            places(w) = ch.ran.randomInt_uni(0, this->n_visible);
+#ifdef SPIN
+            deltas(w) = -2.0 * this->visible(wk.states[w], places(w));
+#else
+            deltas(w) = 1.0 - 2.0 * this->visible(wk.states[w], places(w));
+#endif
+        }
+        proposed = this->W.cols(places);
+        proposed.each_row() %= deltas;
+        proposed += wk.Th;
+        proposed_lc = proposed;
+        proposed_lc.transform([](_type x) { return logCosh(x); });
+        const Row<_type> log_ratios = arma::sum(proposed_lc - wk.LC, 0);
+
+        // acceptance in the log domain - log(u) <= log(|psi'/psi|^2)
+        for (size_t w = 0; w < nw; w++) {
+            const double log_proba = std::real(log_ratios(w) + deltas(w) * this->b_v(places(w)));
+            if (std::log(ch.ran.randomReal_uni()) <= 2.0 * log_proba) {
+                wk.states[w] ^= this->visibleMask(places(w));
+                wk.Th.col(w) = proposed.col(w);
+                wk.LC.col(w) = proposed_lc.col(w);
+            }
         }
     }
-    this->current_state = BASE_TO_INT(this->current_vector);
-    // calculate the effective angles
+}
+
+/*
+* @brief Prepares the walkers of the chain for sampling, the same way as thermalize does for a single chain
+* @param ch chain owning the walkers
+* @param n_therm number of blocks used for the full thermalization
+* @param b_size size of correlation-reducers blocks
+*/
+template<typename _type, typename _hamtype>
+inline void rbmState<_type, _hamtype>::thermalizeWalkers(chain& ch, size_t n_therm, size_t b_size)
+{
+    auto therm_time = std::chrono::high_resolution_clock::now();
+    if (ch.walkers.size() != this->n_walkers) {
+        ch.walkers = rbmWalkers<_type>(this->n_visible, this->n_hidden, this->n_walkers);
+        ch.thermalized = false;
+    }
+    if (this->persistent && ch.thermalized) {
+        // the weights have changed since the last sample
+        this->set_walker_angles(ch);
+        this->walkerSampling(ch, b_size);
+    }
+    else {
+        // set the random states
+        for (size_t w = 0; w < ch.walkers.size(); w++)
+            ch.walkers.states[w] = ch.ran.randomInt_uni(0, this->hilbert_size);
+        this->set_walker_angles(ch);
+        this->walkerSampling(ch, n_therm * b_size);
+        ch.thermalized = true;
+    }
+    PRT(therm_time, this->dbg_thrm);
+}
+
+/*
+* @brief copies the walker into the chain, so that the single chain methods (local energy) can be used
+*/
+template<typename _type, typename _hamtype>
+inline void rbmState<_type, _hamtype>::load_walker(chain& ch, size_t w)
+{
+    ch.current_state = ch.walkers.states[w];
+    INT_TO_BASE_BIT(ch.current_state, ch.current_vector);
+    ch.thetas = ch.walkers.Th.col(w);
+}
+
+/*
+* @brief Prepares the chain for sampling. By default the chain starts from a random state and is thermalized for
+* n_therm blocks. Persistent chains that were already thermalized only resynchronise the angles with the current
+* weights and are re-equilibrated for a single block.
+* @param ch chain to be thermalized
+* @param n_therm number of blocks used for the full thermalization
+* @param b_size size of correlation-reducers blocks
+* @param n_flips number of flips during a single step
+*/
+template<typename _type, typename _hamtype>
+inline void rbmState<_type, _hamtype>::thermalize(chain& ch, size_t n_therm, size_t b_size, size_t n_flips)
+{
+    auto therm_time = std::chrono::high_resolution_clock::now();
+    if (this->persistent && ch.thermalized) {
+        // the weights have changed since the last sample
+        this->set_angles(ch);
+        this->blockSampling(ch, b_size, n_flips);
+    }
+    else {
+        // set the random state
+        this->set_rand_state(ch);
+        this->blockSampling(ch, n_therm * b_size, n_flips);
+        ch.thermalized = true;
+    }
+    PRT(therm_time, this->dbg_thrm);
 }
 
 /*
@@ -660,10 +1303,8 @@ void rbmState<_type, _hamtype>::blockSampling(size_t b_size, u64 start_state, si
 */
 template<typename _type, typename _hamtype>
 Col<_type> rbmState<_type, _hamtype>::mcSampling(size_t n_samples, size_t n_blocks, size_t n_therm, size_t b_size, size_t n_flips){
-#ifdef S_REGULAR
     this->current_b_reg = this->b_reg_mult;
-#endif
-    
+
     // start the timer!
     auto start = std::chrono::high_resolution_clock::now();
     // make the pbar!
@@ -678,82 +1319,89 @@ Col<_type> rbmState<_type, _hamtype>::mcSampling(size_t n_samples, size_t n_bloc
     Col<_type> averageWeights(this->full_size);
     Col<_type> meanEnergies(n_samples, arma::fill::zeros);
     Col<_type> energies(norm, arma::fill::zeros);
-    //Mat<_type> derivatives(this->full_size, norm, arma::fill::zeros);
+#ifdef RBM_BATCH_LOCEN
+    v_1d<u64> sampled_states(norm);
+#endif
+    this->derivatives = rbmDerivatives<_type>(this->n_visible, this->n_hidden, norm);
 
     for(auto i = 0; i < n_samples; i++){
-        // set the random state at each Monte Carlo iteration
-        this->set_rand_state();
-        //this->set_angles();
-
-        // start the simulation
-#ifdef USE_SR
-        this->S.zeros();                                                                // Fisher info
-#endif // SR
-        this->F.zeros();                                                                // Gradient force
-        averageWeights.zeros();                                                         // Weights gradients average
-
-        // thermalize system
-        auto therm_time = std::chrono::high_resolution_clock::now();
-        this->blockSampling(n_therm * b_size, this->current_state, n_flips, true);
-        PRT(therm_time, this->dbg_thrm);
-
-        // to check whether the batch is ready already
-
-        
+        // start the simulation - each chain takes every n_chains'th sample
         auto blocks_time = std::chrono::high_resolution_clock::now();
-        for(auto took = 0; took < norm; took++){
-            // block sample the stuff
-            auto sample_time = std::chrono::high_resolution_clock::now();
-            this->blockSampling(b_size, this->current_state, n_flips, false);
-            PRT(sample_time, this->dbg_samp);
-
-
-            //if (norm == (n_blocks - n_therm) || this->hamil->ran.randomReal_uni() <= batch_proba) {
-            auto gradients_time = std::chrono::high_resolution_clock::now();
-
-
-            this->calcVarDeriv(this->current_vector);
-            // append local energies
-            const _type locEnergy = this->locEn();
-#ifdef USE_SR
-            // append covariance matrices with the first part of covariance <O_k*O_k'>
-            setColumnTimesRow(this->S, this->O_flat, true);
+#ifndef DEBUG
+#pragma omp parallel for num_threads(this->thread_num)
 #endif
-            // append gradient forces with the first part of covariance <E_kO_k*>
-            //this->F += locEnergy * arma::conj(this->O_flat);
-            setConstTimesCol(this->F, locEnergy, this->O_flat, true, true);
-
-            // average weight gradients (conjugate)
-            averageWeights += this->O_flat;
-                
-            // append number of elements taken
-            energies(took) = locEnergy;
-
-            PRT(gradients_time, this->dbg_grad);
-            //}
+        for (auto c = 0; c < this->n_chains; c++) {
+            auto& ch = this->chains[c];
+            if (this->n_walkers > 1) {
+                // each block of the walkers gives n_walkers consecutive samples
+                this->thermalizeWalkers(ch, n_therm, b_size);
+                for (auto first = c * this->n_walkers; first < norm; first += this->n_chains * this->n_walkers) {
+                    auto sample_time = std::chrono::high_resolution_clock::now();
+                    this->walkerSampling(ch, b_size);
+                    PRT(sample_time, this->dbg_samp);
+
+                    auto gradients_time = std::chrono::high_resolution_clock::now();
+                    for (size_t w = 0; w < this->n_walkers && first + w < norm; w++) {
+                        const auto took = first + w;
+                        INT_TO_BASE_BIT(ch.walkers.states[w], ch.tmp_vector);
+                        this->derivatives.V.col(took) = ch.tmp_vector;
+                        this->derivatives.Th.col(took) = arma::tanh(ch.walkers.Th.col(w));
+#ifdef RBM_BATCH_LOCEN
+                        sampled_states[took] = ch.walkers.states[w];
+#else
+                        this->load_walker(ch, w);
+                        energies(took) = this->locEn(ch);
+#endif
+                    }
+                    PRT(gradients_time, this->dbg_grad);
+                }
+                continue;
+            }
+            // thermalize the chain (from a random state or from the previous iteration)
+            this->thermalize(ch, n_therm, b_size, n_flips);
+
+            for (auto took = c; took < norm; took += this->n_chains) {
+                // block sample the stuff
+                auto sample_time = std::chrono::high_resolution_clock::now();
+                this->blockSampling(ch, b_size, n_flips);
+                PRT(sample_time, this->dbg_samp);
+
+                auto gradients_time = std::chrono::high_resolution_clock::now();
+                this->calcVarDeriv(ch);
+                this->derivatives.V.col(took) = ch.current_vector;
+                this->derivatives.Th.col(took) = ch.tanh_thetas;
+                // append local energies
+#ifdef RBM_BATCH_LOCEN
+                sampled_states[took] = ch.current_state;
+#else
+                energies(took) = this->locEn(ch);
+#endif
+                PRT(gradients_time, this->dbg_grad);
+            }
         }
         PRT(blocks_time, this->dbg_blck);
+#ifdef RBM_BATCH_LOCEN
+        // local energies of all samples at once
+        this->locEn(sampled_states, energies);
+#endif
 
-        // normalize
+        // averages and forces from the stored derivatives
         auto meanLocEn = arma::mean(energies);
-        averageWeights /= double(norm);
-        this->F /= double(norm);
+        averageWeights = this->derivatives.mean();
 
+        // center the derivatives, S = <(O_k - <O_k>)*(O_k' - <O_k'>)>
+        this->derivatives.center(averageWeights);
 
-        // append gradient forces with the first part of covariance <E_k><O_k*>
-        //this->F -= meanLocEn * arma::conj(averageWeights);
-        setConstTimesCol(this->F, meanLocEn, averageWeights, false, true);
+        // gradient forces <E_kO_k*> - <E_k><O_k*> as the centered derivatives times the energies
+        this->F = arma::conj(sr_O(this->derivatives, Col<_type>(arma::conj(energies)))) / double(norm);
 
 #ifdef USE_SR
-        this->S /= double(norm);
-        // append covariance matrices with the first part of covariance <O_k*><O_k'>
-        setColumnTimesRow(this->S, averageWeights, false);
-        //this->S -= averageWeights * averageWeights.t();
+        if (this->sr_type == impDef::sr_types::dense)
+            // upper triangle of S = Oc^* Oc^T / N from the blocks of the factored derivatives
+            sr_cov_upper(this->derivatives, this->S);
         // update model
-        this->updVarDerivSR(i);
-    #ifdef S_REGULAR
+        this->updVarDerivSR(i, energies);
         this->current_b_reg = this->current_b_reg * b_reg;
-    #endif // S_REGULAR
 #elif defined USE_ADAM
         this->adam->update(this->F);
         this->F = this->adam->get_grad();
@@ -767,7 +1415,7 @@ Col<_type> rbmState<_type, _hamtype>::mcSampling(size_t n_samples, size_t n_bloc
         this->set_weights();
         // add energy
         meanEnergies(i) = meanLocEn;
-        
+
 
 
         // update the progress bar
@@ -775,6 +1423,9 @@ Col<_type> rbmState<_type, _hamtype>::mcSampling(size_t n_samples, size_t n_bloc
             pbar.printWithTime("-> PROGRESS");
     }
     stouts("->\t\t\tMonte Carlo energy search ", start);
+#ifdef USE_SR
+    stout << "->\t\t\t" << this->get_sr_report() << EL;
+#endif
     return meanEnergies;
 }
 
@@ -799,44 +1450,45 @@ inline std::map<u64, _type> rbmState<_type, _hamtype>::avSampling(size_t n_sampl
     // make the pbar!
     this->pbar = pBar(25, n_samples);
 
-    // states to be returned
+    // states to be returned and the logarithms of their amplitudes
     std::map<u64, _type> states;
-    
+    std::map<u64, _type> log_states;
+
     auto Ns = this->hamil->lattice->get_Ns();
 
-    // set the random state at each Monte Carlo iteration
-    this->set_rand_state();
+    // the averages are collected along the first chain
+    auto& ch = this->chains[0];
 
     this->op.reset();
     for (auto r = 0; r < n_samples; r++) {
-        // set the random state at each Monte Carlo iteration
-        this->set_rand_state();
-
-        // thermalize system
-        auto therm_time = std::chrono::high_resolution_clock::now();
-        this->blockSampling(n_therm * b_size, this->current_state, n_flips, true);
-        PRT(therm_time, this->dbg_thrm);
+        // thermalize the chain (from a random state or from the previous sample)
+        this->thermalize(ch, n_therm, b_size, n_flips);
         for (int i = 0; i < n_blocks; i++) {
 
             // block sample the stuff
             auto sample_time = std::chrono::high_resolution_clock::now();
-            this->blockSampling(b_size, this->current_state, n_flips, false);
+            this->blockSampling(ch, b_size, n_flips);
             PRT(sample_time, this->dbg_samp);
 
-            // look at the states coefficient (not found)
-
-            auto coefficient = this->coeff(this->current_vector);
-            if (!valueEqualsPrec(std::abs(coefficient), 0.0, 1e-2)) {
-                states[this->current_state] = coefficient;
-            }
+            // save the logarithm of the states coefficient
+            log_states[ch.current_state] = this->log_psi(ch.current_vector);
 
             // append local energies
-            this->collectAv(this->locEn());
+            this->collectAv(ch, this->locEn(ch));
         }
         // update the progress bar
         if (r % pbar.percentageSteps == 0)
             pbar.printWithTime("-> PROGRESS");
     }
+    // exponentiate the coefficients relative to the largest one so that they do not overflow
+    double max_log = -std::numeric_limits<double>::infinity();
+    for (const auto& [state, log_val] : log_states)
+        max_log = std::max(max_log, std::real(log_val));
+    for (const auto& [state, log_val] : log_states) {
+        auto coefficient = std::exp(log_val - max_log);
+        if (!valueEqualsPrec(std::abs(coefficient), 0.0, 1e-2))
+            states[state] = coefficient;
+    }
     //stout << this->op.s_z_cor << EL;
     this->op.normalise(n_samples * n_blocks, this->hamil->lattice->get_spatial_norm());
     //stout << this->op.s_z_cor << EL;
@@ -854,49 +1506,52 @@ inline std::map<u64, _type> rbmState<_type, _hamtype>::avSampling(size_t n_sampl
 }
 
 /*
-* 
+* @brief collects the operators averages at the current state of the chain. The sigma_z ones follow from the spins
+* and the sigma_x site terms from the kernel of all the single flips. The correlation of the pair f < g is the ratio of
+* the flip f times the ratio of the flip g from the angles theta + a_f, a_f = d_f W(:, f), so every row reuses the
+* log cosh kernel and each pair is exponentiated once - the upper triangle costs O(Ns^2 n_hidden) without any decoding
+* and neither the saturated tanh(theta) nor the product over the hidden units can lose the accuracy or overflow.
+* @param ch chain at which state the operators are calculated
+* @param loc_en local energy at the current state
 */
 template<typename _type, typename _hamtype>
-inline void rbmState<_type, _hamtype>::collectAv(_type loc_en)
-{   
-    auto Ns = this->hamil->lattice->get_Ns();
-    //stout << VEQ(this->current_state) << EL;
-    // calculate sigma_z 
-    double s_z = 0.0;
-#pragma omp parallel for reduction(+ : s_z)
-    for (int i = 0; i < Ns; i++) {
-        const auto& [state, val] = Operators<double>::sigma_z(this->current_state, Ns, v_1d<int>({ i }));
-        this->op.s_z_i(i) += real(val);
-        //stout << VEQ(val) << EL;
-        s_z += real(val);
-        for (int j = 0; j < Ns; j++) {
-            //const auto [x, y, z] = this->hamil->lattice->getSiteDifference(i, j);
-            const auto& [state, val] = Operators<double>::sigma_z(this->current_state, Ns, v_1d<int>({ i, j }));
-            //stout << x << "," << y << "," << z << "->" << VEQ(val) << EL;
-            //this->op.s_z_cor[abs(x)][abs(y)][abs(z)] += std::real(val);
-            this->op.s_z_cor(i, j) += std::real(val);
-        }
-    }
-    this->op.s_z += real(s_z / double(Ns));
-
-
-
+inline void rbmState<_type, _hamtype>::collectAv(chain& ch, _type loc_en)
+{
+    const int Ns = this->hamil->lattice->get_Ns();
+    // calculate sigma_z
+    Col<double> spins(Ns);
+    for (int i = 0; i < Ns; i++)
+        spins(i) = checkBit(ch.current_state, Ns - 1 - i) ? 1.0 : -1.0;
+    this->op.s_z_i += spins;
+    this->op.s_z_cor += spins * spins.t();
+    this->op.s_z += arma::mean(spins);
 
     // calculate sigma_x
-    cpx s_x = 0.0;
-#pragma omp parallel for reduction(+ : s_x)
+#ifndef RBM_ANGLES_UPD
+    this->set_angles(ch);
+#endif
+    // site terms from the kernel of all the flips
+    this->log_ratios_flips(ch, ch.flip_log_ratios);
+    const cpx s_x = arma::accu(arma::exp(ch.flip_log_ratios));
+
+    // the pair (i, j > i) is the flip i followed by the flip j from the angles theta + a_i, all in the log domain
+    Row<_type> deltas(Ns);
+    for (int f = 0; f < Ns; f++)
+        deltas(f) = this->flipDelta(ch, f);
+    const Row<_type> log_biases = deltas % this->b_v.st();
+
+    // the rows are split between the threads, the row i sets the elements (i, j >= i) and their mirrors
+#pragma omp parallel for schedule(dynamic)
     for (int i = 0; i < Ns; i++) {
-        const auto& [state, val] = Operators<double>::sigma_x(this->current_state, Ns, v_1d<int>({ i }));
-        _type v = val;
-        if (state != this->current_state)
-            v = this->pRatioValChange(v, state);
-        s_x += v;
-        for (int j = 0; j < Ns; j++) {
-            //const auto [x, y, z] = this->hamil->lattice->getSiteDifference(i, j);
-            const auto& [state, val] = Operators<double>::sigma_x(this->current_state, Ns, v_1d<int>({ i, j }));
-            v = this->pRatioValChange(val, state);
-            //this->op.s_x_cor[abs(x)][abs(y)][abs(z)] += std::real(val);
-            this->op.s_x_cor(i, j) += std::real(v);
+        this->op.s_x_cor(i, i) += 1.0;
+        if (i + 1 == Ns)
+            continue;
+        const Col<_type> thetas_i = ch.thetas + deltas(i) * this->W.col(i);
+        const Row<_type> log_pairs = ch.flip_log_ratios(i) + log_biases.tail(Ns - i - 1) + this->log_cosh_shifts(thetas_i, deltas, i + 1);
+        for (int j = i + 1; j < Ns; j++) {
+            const double pair = std::real(std::exp(log_pairs(j - i - 1)));
+            this->op.s_x_cor(i, j) += pair;
+            this->op.s_x_cor(j, i) += pair;
         }
     }
     this->op.s_x += real(s_x / double(Ns));
@@ -905,4 +1560,4 @@ inline void rbmState<_type, _hamtype>::collectAv(_type loc_en)
 }
 
 
-#endif // !RBM_H
\ No newline at end of file
+#endif // !RBM_H
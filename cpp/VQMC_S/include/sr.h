@@ -0,0 +1,350 @@
+#pragma once
+#ifndef COMMON_H
+#include "../src/common.h"
+#endif
+
+#ifndef SR_H
+#define SR_H
+
+/*
+* @brief timing report of a stochastic reconfiguration solver
+* @param name name of the solver
+* @param calls number of solutions
+* @param time total time [s]
+*/
+inline std::string sr_report(const std::string& name, size_t calls, double time) {
+	return "SR solver " + name + ": " + VEQ(calls) + "," + VEQP(time, 4) + "," + \
+		"mean_ms=" + str_p(calls > 0 ? 1e3 * time / double(calls) : 0.0, 4);
+}
+
+// ----------------------------------------------------------------------------- DERIVATIVES STORAGE
+/*
+* The solvers only access the centered derivatives Oc (parameters x samples) through the functions below so that
+* other storages (e.g. a factored one) can provide their own overloads found by the argument dependent lookup.
+*/
+
+/*
+* @brief number of samples stored
+*/
+template <typename _type>
+inline size_t sr_samples(const arma::Mat<_type>& Oc) {
+	return Oc.n_cols;
+}
+
+/*
+* @brief transpose of the derivatives times a parameters vector - Oc^T x
+*/
+template <typename _type>
+inline arma::Col<_type> sr_Ot(const arma::Mat<_type>& Oc, const arma::Col<_type>& x) {
+	return Oc.st() * x;
+}
+
+/*
+* @brief derivatives times a samples vector - Oc y
+*/
+template <typename _type>
+inline arma::Col<_type> sr_O(const arma::Mat<_type>& Oc, const arma::Col<_type>& y) {
+	return Oc * y;
+}
+
+/*
+* @brief samples Gram matrix of the derivatives - Oc^T Oc^*
+*/
+template <typename _type>
+inline arma::Mat<_type> sr_gram(const arma::Mat<_type>& Oc) {
+	return Oc.st() * arma::conj(Oc);
+}
+
+/*
+* @brief rows [first, last] of the derivatives, i.e. a block of the parameters for all the samples
+*/
+template <typename _type>
+inline arma::Mat<_type> sr_rows(const arma::Mat<_type>& Oc, size_t first, size_t last) {
+	return Oc.rows(first, last);
+}
+
+/*
+* @brief upper triangle of the covariance S = Oc^* Oc^T / N built as the rank-N update of the blocks of the parameters.
+* Only the blocks (i, j) with i <= j are multiplied and only block x samples rows of the derivatives are materialized
+* at once, so neither the full Y = Oc^* / sqrt(N) nor the lower triangle is ever formed.
+* @param Oc centered derivatives with samples in columns
+* @param S covariance matrix (parameters x parameters), the strictly lower triangle is not set
+* @param block number of the parameters in a single block
+*/
+template <typename _Op, typename _type>
+inline void sr_cov_upper(const _Op& Oc, arma::Mat<_type>& S, size_t block = 256) {
+	const size_t n = S.n_rows;
+	const double N = double(sr_samples(Oc));
+	for (size_t j0 = 0; j0 < n; j0 += block) {
+		const size_t j1 = std::min(j0 + block, n) - 1;
+		const arma::Mat<_type> Yj = sr_rows(Oc, j0, j1);
+		for (size_t i0 = 0; i0 <= j0; i0 += block) {
+			const size_t i1 = std::min(i0 + block, n) - 1;
+			S.submat(i0, j0, i1, j1) = arma::conj(i0 == j0 ? Yj : sr_rows(Oc, i0, i1)) * Yj.st() / N;
+		}
+	}
+}
+
+/*
+* @brief Matrix-free stochastic reconfiguration. The covariance matrix S = <O^*O^T> - <O^*><O^T> is never formed,
+* its action on a vector is calculated from the centered derivatives Oc (parameters x samples) as
+* S x = Oc^* (Oc^T x) / N and the shifted system (S + shift) x = F is solved with the conjugate gradient method.
+*/
+template<typename _type>
+class SRcg {
+private:
+	size_t size;								// number of variational parameters
+	size_t max_iter = 500;						// maximal number of iterations
+	size_t iter = 0;							// number of iterations used in the last solution
+	double tol = 1e-6;							// relative tolerance on the residual norm
+	double shift = 1e-4;						// diagonal shift regularising the covariance
+	arma::Col<_type> x;							// solution - kept as the starting point of the next solution
+	arma::Col<_type> r;							// residual
+	arma::Col<_type> p;							// search direction
+	arma::Col<_type> Sp;						// covariance times the search direction
+	double time = 0;							// total time spent in the solutions [s]
+	size_t calls = 0;							// number of solutions
+public:
+	// ---------------------------
+	~SRcg() = default;
+	SRcg() = default;
+	SRcg(size_t size)
+		: size(size)
+	{
+		this->initialize();
+	};
+	SRcg(double tol, double shift, size_t max_iter, size_t size)
+		: tol(tol), shift(shift), max_iter(max_iter), size(size)
+	{
+		this->initialize();
+	};
+	/*
+	* resets the solver
+	*/
+	void reset() {
+		this->iter = 0;
+		this->x.zeros();
+	}
+	/*
+	* initialize the solver
+	*/
+	void initialize() {
+		this->x = arma::Col<_type>(size, arma::fill::zeros);
+		this->r = arma::Col<_type>(size, arma::fill::zeros);
+		this->p = arma::Col<_type>(size, arma::fill::zeros);
+		this->Sp = arma::Col<_type>(size, arma::fill::zeros);
+	}
+
+	/*
+	* sets the diagonal shift
+	*/
+	void set_shift(double shift) { this->shift = shift; };
+
+	/*
+	* @brief applies the shifted covariance matrix to a vector without forming it
+	* @param Oc centered derivatives with samples in columns
+	* @param v vector to be multiplied
+	* @param out (S + shift) v
+	*/
+	template <typename _Op>
+	void apply(const _Op& Oc, const arma::Col<_type>& v, arma::Col<_type>& out) const {
+		const arma::Col<_type> w = sr_Ot(Oc, v);
+		out = arma::conj(sr_O(Oc, arma::Col<_type>(arma::conj(w)))) / double(sr_samples(Oc)) + this->shift * v;
+	}
+
+	/*
+	* @brief solves (S + shift) x = F with the conjugate gradient method
+	* @param Oc centered derivatives with samples in columns
+	* @param F forces
+	* @returns the solution
+	*/
+	template <typename _Op>
+	const arma::Col<_type>& solve(const _Op& Oc, const arma::Col<_type>& F) {
+		auto start = std::chrono::high_resolution_clock::now();
+		this->apply(Oc, this->x, this->Sp);
+		this->r = F - this->Sp;
+		this->p = this->r;
+		const double stop = this->tol * this->tol * std::real(arma::cdot(F, F));
+		double rs_old = std::real(arma::cdot(this->r, this->r));
+		for (this->iter = 0; this->iter < this->max_iter && rs_old > stop; this->iter++) {
+			this->apply(Oc, this->p, this->Sp);
+			const _type alpha = rs_old / arma::cdot(this->p, this->Sp);
+			this->x += alpha * this->p;
+			this->r -= alpha * this->Sp;
+			const double rs_new = std::real(arma::cdot(this->r, this->r));
+			this->p = this->r + (rs_new / rs_old) * this->p;
+			rs_old = rs_new;
+		}
+		this->time += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		this->calls++;
+		return this->x;
+	}
+
+	/*
+	* get the solution and the number of iterations
+	*/
+	const arma::Col<_type>& get_x()					const { return this->x; };
+	size_t get_iter()								const { return this->iter; };
+
+	/*
+	* timing report of the solver
+	*/
+	std::string report()							const { return sr_report("cg", this->calls, this->time); };
+};
+
+/*
+* @brief Sample-space stochastic reconfiguration (minSR) for the number of samples much smaller than the number of
+* parameters. With Y = Oc^* / sqrt(N) the covariance is S = Y Y^H and the forces are F = Y Ec / sqrt(N), where Ec
+* are the centered local energies. Then (S + shift) x = F is solved through the N x N problem
+* x = Y (Y^H Y + shift)^{-1} Ec / sqrt(N), where Y^H Y = Oc^T Oc^* / N.
+*/
+template<typename _type>
+class SRmin {
+private:
+	double shift = 1e-4;						// diagonal shift regularising the covariance
+	arma::Mat<_type> T;							// sample-space covariance Y^H Y
+	arma::Col<_type> y;							// sample-space solution
+	arma::Col<_type> x;							// parameter-space solution
+	double time = 0;							// total time spent in the solutions [s]
+	size_t calls = 0;							// number of solutions
+public:
+	// ---------------------------
+	~SRmin() = default;
+	SRmin() = default;
+	SRmin(double shift)
+		: shift(shift)
+	{};
+
+	/*
+	* sets the diagonal shift
+	*/
+	void set_shift(double shift) { this->shift = shift; };
+
+	/*
+	* @brief solves (S + shift) x = F in the sample space
+	* @param Oc centered derivatives with samples in columns
+	* @param E local energies of the samples
+	* @returns the solution
+	*/
+	template <typename _Op>
+	const arma::Col<_type>& solve(const _Op& Oc, const arma::Col<_type>& E) {
+		auto start = std::chrono::high_resolution_clock::now();
+		const double N = double(E.n_elem);
+		this->T = sr_gram(Oc) / N;
+		this->T.diag() += this->shift;
+		this->y = arma::solve(this->T, arma::Col<_type>((E - arma::mean(E)) / std::sqrt(N)), arma::solve_opts::likely_sympd);
+		this->x = arma::conj(sr_O(Oc, arma::Col<_type>(arma::conj(this->y)))) / std::sqrt(N);
+		this->time += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		this->calls++;
+		return this->x;
+	}
+
+	/*
+	* get the solution
+	*/
+	const arma::Col<_type>& get_x()					const { return this->x; };
+
+	/*
+	* timing report of the solver
+	*/
+	std::string report()							const { return sr_report("minSR", this->calls, this->time); };
+};
+
+/*
+* @brief Dense stochastic reconfiguration with a runtime selected factorization of the covariance matrix:
+* pseudo-inverse, explicit inverse, LU, Cholesky or the eigendecomposition with a relative cutoff.
+*/
+template<typename _type>
+class SRdense {
+private:
+	impDef::sr_dense_solvers solver;			// the factorization used
+	double pinv_tol = 5e-5;						// tolerance of the pseudo-inverse singular values
+	double eig_cutoff = 1e-10;					// relative cutoff of the eigenvalues
+	arma::Mat<_type> R;							// Cholesky factor
+	arma::Mat<_type> U;							// eigenvectors
+	arma::vec eigval;							// eigenvalues
+	arma::Col<_type> x;							// solution
+	double time = 0;							// total time spent in the solutions [s]
+	size_t calls = 0;							// number of solutions
+public:
+	// ---------------------------
+	~SRdense() = default;
+	SRdense() = default;
+	SRdense(impDef::sr_dense_solvers solver)
+		: solver(solver)
+	{};
+
+	/*
+	* @brief name of the factorization
+	*/
+	static std::string get_name(impDef::sr_dense_solvers solver) {
+		switch (solver) {
+		case impDef::sr_dense_solvers::pinv:		return "pinv";
+		case impDef::sr_dense_solvers::inverse:		return "inverse";
+		case impDef::sr_dense_solvers::lu:			return "lu";
+		case impDef::sr_dense_solvers::cholesky:	return "cholesky";
+		case impDef::sr_dense_solvers::eig:			return "eig";
+		default:									return "unknown";
+		}
+	}
+
+	/*
+	* @brief solves (S + shift) x = F. The pseudo-inverse does not use the shift.
+	* @param S covariance matrix with the upper triangle set (see sr_cov_upper), completed and shifted in place
+	* @param F forces
+	* @param shift diagonal shift regularising the covariance
+	* @returns the solution
+	*/
+	const arma::Col<_type>& solve(arma::Mat<_type>& S, const arma::Col<_type>& F, double shift) {
+		auto start = std::chrono::high_resolution_clock::now();
+		// reflect the upper triangle in place - no copy of the covariance is made
+		S = arma::symmatu(S);
+		switch (this->solver) {
+		case impDef::sr_dense_solvers::pinv:
+			this->x = arma::pinv(S, this->pinv_tol, "std") * F;
+			break;
+		case impDef::sr_dense_solvers::inverse:
+			S.diag() += shift;
+			this->x = S.i() * F;
+			break;
+		case impDef::sr_dense_solvers::cholesky:
+			S.diag() += shift;
+			// S = R^H R, fall back to LU if the shifted matrix is not positive definite
+			if (arma::chol(this->R, S)) {
+				this->x = arma::solve(arma::trimatu(this->R), arma::Col<_type>(arma::solve(arma::trimatl(this->R.t()), F)));
+				break;
+			}
+			this->x = arma::solve(S, F);
+			break;
+		case impDef::sr_dense_solvers::eig:
+			// fall back to LU if the eigendecomposition fails, the factors of the previous step are not used
+			if (arma::eig_sym(this->eigval, this->U, S)) {
+				const arma::Col<_type> c = this->U.t() * F;
+				const double cut = this->eig_cutoff * arma::max(arma::abs(this->eigval));
+				arma::Col<_type> y(c.n_elem, arma::fill::zeros);
+				for (auto k = 0; k < c.n_elem; k++)
+					if (this->eigval(k) > cut)
+						y(k) = c(k) / (this->eigval(k) + shift);
+				this->x = this->U * y;
+				break;
+			}
+			S.diag() += shift;
+			this->x = arma::solve(S, F);
+			break;
+		default:
+			S.diag() += shift;
+			this->x = arma::solve(S, F);
+			break;
+		}
+		this->time += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		this->calls++;
+		return this->x;
+	}
+
+	/*
+	* timing report of the solver
+	*/
+	std::string report()							const { return sr_report("dense " + get_name(this->solver), this->calls, this->time); };
+};
+
+#endif
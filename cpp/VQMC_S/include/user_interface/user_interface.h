@@ -80,6 +80,8 @@
 
 // maximal ed size to compare
 constexpr int maxed = 20;
+// maximal size to compare with the matrix-free Lanczos
+constexpr int maxed_mf = 32;
 
 
 namespace rbm_ui {
@@ -89,6 +91,13 @@ namespace rbm_ui {
 	{"nb","500"},								// number of blocks	
 	{"bs","8"},									// block size
 	{"nh","2"},									// hidden parameters
+	{"nc","1"},									// number of Markov chains
+	{"nw","1"},									// number of walkers of each chain
+	{"pc","0"},									// persistent Markov chains
+	{"smp","0"},								// Markov chain sampler
+	{"sr","0"},									// stochastic reconfiguration solver
+	{"srd","0"},								// dense stochastic reconfiguration factorization
+	{"srs","0"},								// stochastic reconfiguration regularisation schedule
 	// lattice parameters
 	{"d","1"},									// dimension
 	{"lx","4"},
@@ -112,6 +121,16 @@ namespace rbm_ui {
 	{"ky", "0.0"},								// kitaev y interaction
 	{"kz", "0.0"},								// kitaev z interaction
 	{"k0", "0.0"},								// kitaev interaction disorder
+	// pauli strings
+	{"hf", ""},									// file with the Pauli strings
+	// exact diagonalization symmetries
+	{"sym", "0"},								// translations
+	{"qx", "0"},								// momentum along x
+	{"qy", "0"},								// momentum along y
+	{"par", "0"},								// reflection parity
+	{"sf", "0"},								// spin flip parity
+	{"nup", "-1"},								// number of the up spins
+	{"lz", "0"},								// matrix-free Lanczos beyond the ED
 	// other
 	{"th","1"},									// number of threads
 	{"q","0"},									// quiet?
@@ -234,6 +253,19 @@ namespace rbm_ui {
 		double Kz = 1;
 		double K0 = 0.0;
 
+		// pauli strings
+		string ham_file = "";														// file with the weighted Pauli strings
+
+		// exact diagonalization symmetries
+		bool sym = false;															// use the translations
+		int qx = 0;																	// momentum along x in 2pi/Lx
+		int qy = 0;																	// momentum along y in 2pi/Ly
+		int par = 0;																// reflection parity (0 - not used)
+		int sf = 0;																	// spin flip parity (0 - not used)
+		int n_up = -1;																// number of the up spins (-1 - not used)
+		spinSymmetries ed_sym;														// the symmetry sector, checked with the model
+		bool lanczos = false;														// matrix-free Lanczos for maxed < Ns <= maxed_mf
+
 		// heisenberg with classical dots stuff
 		v_1d<int> positions = {};
 		vec phis = vec({});
@@ -252,6 +284,13 @@ namespace rbm_ui {
 		size_t block_size = 8;
 		size_t n_therm = size_t(0.1 * n_blocks);
 		size_t n_flips = 1;
+		size_t n_chains = 1;
+		size_t n_walkers = 1;
+		bool persistent = false;
+		impDef::sampler_types sampler = impDef::sampler_types::metropolis;
+		impDef::sr_types sr_type = impDef::sr_types::dense;
+		impDef::sr_dense_solvers sr_dense = impDef::sr_dense_solvers::pinv;
+		bool sr_schedule = false;
 		double lr = 1e-2;
 
 		// others 
@@ -315,6 +354,35 @@ void rbm_ui::ui<_type, _hamtype>::exit_with_help()
 		" options:\n"
 		"-f input file for all of the options : (default none) \n"
 		"-m monte carlo steps : bigger than 0 (default 300) \n"
+		"-nc number of independent Markov chains sampled in parallel : bigger than 0 (default 1) \n"
+		"-nw number of walkers advanced in lockstep by each chain, each block gives a sample of every walker, not with -smp 1 : bigger than 0 (default 1) \n"
+		"-pc persistent Markov chains between the iterations : 0 or 1 (default 0 -> restart from random states) \n"
+		"-smp Markov chain sampler : (default metropolis) \n"
+		"	0 -- Metropolis single flips \n"
+		"	1 -- rejection-free continuous time single flips, -bs is the time in the Metropolis proposals. Each event costs \n"
+		"	     n_hidden x n_visible log cosh against n_hidden of a proposal, so it pays off only for the acceptance \n"
+		"	     below about 1 / n_visible. Single walker only \n"
+		"-sr stochastic reconfiguration solver : (default dense) \n"
+		"	0 -- dense covariance matrix \n"
+		"	1 -- matrix-free conjugate gradient \n"
+		"	2 -- sample-space solution (minSR), for less samples than parameters \n"
+		"-srd factorization of the dense stochastic reconfiguration : (default pinv) \n"
+		"	0 -- pseudo-inverse \n"
+		"	1 -- explicit inverse \n"
+		"	2 -- LU \n"
+		"	3 -- Cholesky \n"
+		"	4 -- eigendecomposition with cutoff \n"
+		"-srs decaying regularisation of the covariance : 0 or 1 (default 0 -> constant shift) \n"
+		"-hf file with the weighted Pauli strings for -mod 4 : (default none) \n"
+		"	text -- coefficient and operators with sites in each line, e.g. 0.5 X0 X1 \n"
+		"	.bin -- records of uint32 count, double re, double im and count x (char operator, int32 site) \n"
+		"-sym translational symmetry of the ED (square lattice with PBC) : 0 or 1 (default 0) \n"
+		"-qx -qy momentum sector of the ED in the units of 2pi/L, the real Hamiltonian allows only 0 or pi : (default 0) \n"
+		"-par reflection parity sector of the ED, needs the momentum 0 or pi : -1, 0 or 1 (default 0 -> not used) \n"
+		"-sf spin flip parity sector of the ED : -1, 0 or 1 (default 0 -> not used) \n"
+		"-nup number of the up spins in the ED and Lanczos, needs the conserved magnetization, not with -sym, -par or -sf : (default -1 -> not used) \n"
+		"-lz matrix-free Lanczos ground energy above the ED size, up to 32 sites. It keeps four vectors of the 2^Ns basis \n"
+		"	(or of the -nup sector), e.g. 128GB of doubles for Ns = 32 : 0 or 1 (default 0) \n"
 		"-d dimension : set dimension (default 2) \n"
 		"	1 -- 1D \n"
 		"	2 -- 2D \n"
@@ -365,6 +433,18 @@ void rbm_ui::ui<_type, _hamtype>::set_default()
 	this->Kz = 1;
 	this->K0 = 0.0;
 
+	// pauli strings
+	this->ham_file = "";
+
+	// exact diagonalization symmetries
+	this->sym = false;
+	this->qx = 0;
+	this->qy = 0;
+	this->par = 0;
+	this->sf = 0;
+	this->n_up = -1;
+	this->lanczos = false;
+
 	// heisenberg with classical dots stuff
 	this->positions = { 0 };
 	this->phis = vec({ 0 });
@@ -383,6 +463,13 @@ void rbm_ui::ui<_type, _hamtype>::set_default()
 	this->block_size = 8;
 	this->n_therm = size_t(0.1 * this->n_blocks);
 	this->n_flips = 1;
+	this->n_chains = 1;
+	this->n_walkers = 1;
+	this->persistent = false;
+	this->sampler = impDef::sampler_types::metropolis;
+	this->sr_type = impDef::sr_types::dense;
+	this->sr_dense = impDef::sr_dense_solvers::pinv;
+	this->sr_schedule = false;
 	this->lr = 1e-2;
 }
 
@@ -417,6 +504,39 @@ inline void rbm_ui::ui<_type, _hamtype>::parseModel(int argc, const v_1d<string>
 	choosen_option = "-bs";
 	this->set_option(this->block_size, argv, choosen_option);
 	
+	// number of Markov chains
+	choosen_option = "-nc";
+	this->set_option(this->n_chains, argv, choosen_option);
+
+	// number of walkers of each chain
+	choosen_option = "-nw";
+	this->set_option(this->n_walkers, argv, choosen_option);
+
+	// persistent Markov chains
+	choosen_option = "-pc";
+	this->set_option(this->persistent, argv, choosen_option, false);
+
+	// Markov chain sampler
+	choosen_option = "-smp";
+	this->set_option(this->sampler, argv, choosen_option, false);
+	// the walkers are advanced by the Metropolis sweeps only
+	if (this->n_walkers > 1 && this->sampler == impDef::sampler_types::rejection_free) {
+		stout << "-smp 1 cannot be combined with more than one walker -nw" << EL;
+		exit_with_help();
+	}
+
+	// stochastic reconfiguration solver
+	choosen_option = "-sr";
+	this->set_option(this->sr_type, argv, choosen_option, false);
+
+	// dense stochastic reconfiguration factorization
+	choosen_option = "-srd";
+	this->set_option(this->sr_dense, argv, choosen_option, false);
+
+	// stochastic reconfiguration regularisation schedule
+	choosen_option = "-srs";
+	this->set_option(this->sr_schedule, argv, choosen_option, false);
+
 	// number of hidden layers
 	choosen_option = "-nh";
 	this->set_option(this->nhidden, argv, choosen_option, false);
@@ -501,6 +621,31 @@ inline void rbm_ui::ui<_type, _hamtype>::parseModel(int argc, const v_1d<string>
 	choosen_option = "-k0";
 	this->set_option(this->K0, argv, choosen_option, false);
 
+	// --- pauli strings ---
+	choosen_option = "-hf";
+	this->set_option(this->ham_file, argv, choosen_option, false);
+
+	// --- exact diagonalization symmetries ---
+	choosen_option = "-sym";
+	this->set_option(this->sym, argv, choosen_option, false);
+	choosen_option = "-qx";
+	this->set_option(this->qx, argv, choosen_option, false);
+	choosen_option = "-qy";
+	this->set_option(this->qy, argv, choosen_option, false);
+	choosen_option = "-par";
+	this->set_option(this->par, argv, choosen_option, false);
+	choosen_option = "-sf";
+	this->set_option(this->sf, argv, choosen_option, false);
+	choosen_option = "-nup";
+	this->set_option(this->n_up, argv, choosen_option, false);
+	// the magnetization sector is not combined with the lattice symmetries
+	if (this->n_up >= 0 && (this->sym || this->par != 0 || this->sf != 0)) {
+		stout << "-nup cannot be combined with the symmetry sectors -sym, -par or -sf" << EL;
+		exit_with_help();
+	}
+	choosen_option = "-lz";
+	this->set_option(this->lanczos, argv, choosen_option, false);
+
 	//---------- OTHERS
 
 	// quiet
@@ -627,6 +772,9 @@ inline void rbm_ui::ui<_type, _hamtype>::define_models()
 	case impDef::ham_types::kitaev_heisenberg:
 		this->ham = std::make_shared<Heisenberg_kitaev<_hamtype>>(J, J0, g, g0, h, w, delta, make_tuple(Kx, Ky, Kz), K0, lat);
 		break;
+	case impDef::ham_types::pauli_strings:
+		this->ham = std::make_shared<PauliStrings<_hamtype>>(ham_file, lat);
+		break;
 	default:
 		this->ham = std::make_shared<IsingModel<_hamtype>>(J, J0, g, g0, h, w, lat);
 		break;
@@ -634,11 +782,38 @@ inline void rbm_ui::ui<_type, _hamtype>::define_models()
 	auto model_info = this->ham->get_info();
 	stout << "\t\t-> " << VEQ(model_info) << EL;
 
+	// reject the symmetry sector of the ED before the simulation
+	if (this->sym || this->par != 0 || this->sf != 0) {
+		try {
+			this->ed_sym = spinSymmetries(this->lat, this->sym, this->qx, this->qy, this->par, this->sf);
+			this->ham->check_symmetries(this->ed_sym);
+		}
+		catch (const char* msg) {
+			stout << msg << EL;
+			exit_with_help();
+		}
+	}
+	// and the magnetization sector, the check itself throws for too long strings
+	if (this->n_up >= 0) {
+		try {
+			magnetizationSector(Ns, this->n_up);
+			if (!this->ham->terms.conserves_magnetization())
+				throw "The Hamiltonian does not conserve the magnetization, -nup cannot be used\n";
+		}
+		catch (const char* msg) {
+			stout << msg << EL;
+			exit_with_help();
+		}
+	}
+
 
 	// rbm stuff
 	this->nhidden = Ns;
 	this->nvisible = this->layer_mult * this->nhidden;
-	this->phi = std::make_unique<rbmState<_type, _hamtype>>(nvisible, nhidden, ham, lr, batch, thread_num);
+	this->phi = std::make_unique<rbmState<_type, _hamtype>>(nvisible, nhidden, ham, lr, batch, thread_num, n_chains, sr_type, sr_dense, sr_schedule);
+	this->phi->set_persistent(this->persistent);
+	this->phi->set_sampler(this->sampler);
+	this->phi->set_walkers(this->n_walkers);
 	auto rbm_info = phi->get_info();
 	stout << "\t\t-> " << VEQ(rbm_info) << EL;
 
@@ -654,6 +829,11 @@ inline void rbm_ui::ui<_type, _hamtype>::compare_ed(double ground_rbm)
 	// test ED
 	auto Ns = this->lat->get_Ns();
 	double ground_ed = 0;
+	const bool use_lanczos = Ns > maxed && Ns <= maxed_mf && this->lanczos;
+	if ((Ns <= maxed || use_lanczos) && this->n_up >= 0) {
+		this->ham->set_magnetization(this->n_up);
+		stout << "\t-> magnetization sector" + this->ham->mag.get_info() + " of dimension " + STR(this->ham->mag.size()) << EL;
+	}
 
 	if (Ns <= maxed) {
 		this->av_op.reset();
@@ -661,16 +841,26 @@ inline void rbm_ui::ui<_type, _hamtype>::compare_ed(double ground_rbm)
 		stout << "\n\n-> starting ED for:\n\t-> " + ham->get_info() << EL;
 		// define the operators class
 		
+		if (this->sym || this->par != 0 || this->sf != 0)
+		{
+			this->ham->set_symmetries(this->ed_sym);
+			stout << "\t-> symmetry sector" + this->ham->sym.get_info() + " of dimension " + STR(this->ham->mapping.size()) << EL;
+		}
+		// the sector of the ED, empty for the full Hilbert space
+		const string sector = this->ham->sym.get_info() + this->ham->mag.get_info();
 		this->ham->hamiltonian();
-		if(Ns <= 12)
+		// the iterative solver needs more states than the eigenvalues asked for
+		if(Ns <= 12 || this->ham->get_hamiltonian().n_rows <= 3)
 			this->ham->diag_h(false);
 		else
 			this->ham->diag_h(false, 3, 0, 1000);
 
 		Operators<_hamtype> op(this->lat); 
+		// the sector may be one dimensional
+		const auto n_energies = this->ham->get_eigenvalues().n_elem;
 		ground_ed = std::real(ham->get_eigenEnergy(0));
-		auto excited_ed = std::real(ham->get_eigenEnergy(1));
-		Col<_hamtype> eigvec = ham->get_eigenState(0);
+		auto excited_ed = n_energies > 1 ? std::real(ham->get_eigenEnergy(1)) : ground_ed;
+		Col<_hamtype> eigvec = ham->get_full_state(0);
 
 		op.calculate_operators(eigvec, this->av_op, true);
 
@@ -685,24 +875,55 @@ inline void rbm_ui::ui<_type, _hamtype>::compare_ed(double ground_rbm)
 		stout << "\t\t\t->" << VEQ(ground_ed) << EL;
 		stout << "\t\t\t->" << VEQ(ground_rbm) << EL;
 		stout << "\t\t\t->" << VEQP(relative_error, 4) << "%" << EL;
+		if (sector != "")
+			stout << "\t\t\t-> the ED ground state is the lowest in the sector" + sector + ", the RBM is not restricted to it" << EL;
 		stout << "------------------------------------------------------------------------" << EL;
-		stout << "GROUND STATE ED ENERGY: " << VEQP(ground_ed, 4) << EL;
-		stout << "1ST EXCITED STATE ED ENERGY: " << VEQP(excited_ed, 4) << EL;
+		stout << "GROUND STATE ED ENERGY" + sector + ": " << VEQP(ground_ed, 4) << EL;
+		if (n_energies > 1)
+			stout << "1ST EXCITED STATE ED ENERGY" + sector + ": " << VEQP(excited_ed, 4) << EL;
 		stout << "GROUND STATE ED SIGMA_X EXTENSIVE: " << VEQP(sx, 4) << EL;
 		stout << "GROUND STATE ED SIGMA_Z EXTENSIVE: " << VEQP(sz, 4) << EL;
 		stout << "\n------------------------------------------------------------------------\n|Psi>=:" << EL;
 		stout << "\t->Ground(" + STRP(ground_ed, 3) + "):" << EL;
-		SpinHamiltonian<_hamtype>::print_state_pretty(ham->get_eigenState(0), Ns, 0.08);
-		stout << "\t->Excited(" + STRP(excited_ed, 3) + "):" << EL;
-		SpinHamiltonian<_hamtype>::print_state_pretty(ham->get_eigenState(1), Ns, 0.08);
+		SpinHamiltonian<_hamtype>::print_state_pretty(ham->get_full_state(0), Ns, 0.08);
+		if (n_energies > 1) {
+			stout << "\t->Excited(" + STRP(excited_ed, 3) + "):" << EL;
+			SpinHamiltonian<_hamtype>::print_state_pretty(ham->get_full_state(1), Ns, 0.08);
+		}
 		stout << "------------------------------------------------------------------------" << EL;
 #ifdef PLOT
 		plt::axhline(ground_ed);
 		plt::axhline(excited_ed);
-		plt::axhline(ham->get_eigenEnergy(2));
+		if (n_energies > 2)
+			plt::axhline(ham->get_eigenEnergy(2));
 		plt::annotate(VEQ(ground_ed) + ",\n" + VEQ(excited_ed) + ",\n" + VEQ(ground_rbm) + ",\n" + VEQ(relative_error) + "%", mcSteps / 3, (ground_rbm) / 2);
 #endif
 	}
+	else if (use_lanczos) {
+		// too big for the sparse matrix - only the ground energy from the matrix-free Lanczos, the excited ones would
+		// need the full reorthogonalization and thus the whole Krylov basis
+		auto diag_time = std::chrono::high_resolution_clock::now();
+		stout << "\n\n-> starting matrix-free Lanczos for:\n\t-> " + ham->get_info() << EL;
+		this->ham->diag_h_lanczos(1);
+		ground_ed = std::real(ham->get_eigenEnergy(0));
+
+		const string sector = this->ham->mag.get_info();
+		stouts("\t\t-> finished Lanczos", diag_time);
+		stout << "\t\t\t->" << VEQ(ground_ed) << EL;
+		stout << "\t\t\t->" << VEQ(ground_rbm) << EL;
+		// the unconverged Ritz value is only an upper bound of the ground energy
+		if (this->ham->get_lanczos_converged()) {
+			auto relative_error = abs(std::real(ground_ed - ground_rbm)) / abs(ground_ed) * 100.;
+			stout << "\t\t\t->" << VEQP(relative_error, 4) << "%" << EL;
+		}
+		else
+			stout << "\t\t\t-> Lanczos not converged, residual " + STRP(this->ham->get_lanczos_residual(), 3) + ", no comparison" << EL;
+		if (sector != "")
+			stout << "\t\t\t-> the Lanczos ground state is the lowest in the sector" + sector + ", the RBM is not restricted to it" << EL;
+		stout << "------------------------------------------------------------------------" << EL;
+		stout << "GROUND STATE ED ENERGY" + sector + (this->ham->get_lanczos_converged() ? "" : " (NOT CONVERGED)") + ": " << VEQP(ground_ed, 4) << EL;
+		stout << "------------------------------------------------------------------------" << EL;
+	}
 }
 
 // -------------------------------- OPERATORS -----------------------------------------
@@ -759,6 +980,11 @@ inline void rbm_ui::ui<_type, _hamtype>::save_operators(clk::time_point start, s
 		fileSave.close();
 		PLOT_V1D(this->av_op.ent_entro, "bond_cut", "$S_0(L)$", "Entanglement entropy\n" + ham->get_info() + "\n" + name);
 		SAVEFIG(filename + ".png", false);
+
+		filename = dir + "_ent_renyi2";
+		openFile(fileSave, filename + ".dat", ios::out);
+		print_vector_1d(fileSave, this->av_op.ent_renyi2);
+		fileSave.close();
 	}
 
 	// --------------------- save log ---------------------	// save the log file and append columns if it is empty
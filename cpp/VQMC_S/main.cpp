@@ -5,15 +5,11 @@
 //#define USE_RMS
 
 #define RBM_ANGLES_UPD
+//#define RBM_BATCH_LOCEN
 #define PLOT
 #define SPIN
 
 
-#ifdef USE_SR
-	#define PINV
-	//#define S_REGULAR
-#endif
-
 
 
 
@@ -31,6 +31,7 @@
 #include <cmath>
 #include <complex>
 #include <cassert>
+#include <bit>
 /// filesystem for directory creation
 #ifdef __has_include
 #  if __has_include(<filesystem>)
@@ -117,7 +118,36 @@ namespace impDef {
 		ising = 0,
 		heisenberg = 1,
 		heisenberg_dots = 2,
-		kitaev_heisenberg = 3
+		kitaev_heisenberg = 3,
+		pauli_strings = 4
+	};
+
+	/*
+	/// Types of the stochastic reconfiguration solvers
+	*/
+	enum sr_types {
+		dense = 0,
+		cg = 1,
+		min_sr = 2
+	};
+
+	/*
+	/// Types of the factorizations used by the dense stochastic reconfiguration
+	*/
+	enum sr_dense_solvers {
+		pinv = 0,
+		inverse = 1,
+		lu = 2,
+		cholesky = 3,
+		eig = 4
+	};
+
+	/*
+	/// Types of the Markov chain samplers of the variational states
+	*/
+	enum sampler_types {
+		metropolis = 0,
+		rejection_free = 1
 	};
 }
 
@@ -157,6 +187,16 @@ inline double tim_mus(clk::time_point start) {
 // -----------------------------------------------------------------------------				TOOLS				-----------------------------------------------------------------------------
 //v_1d<double> fourierTransform(std::initializer_list<const arma::mat&> matToTransform, std::tuple<double,double,double> k, std::tuple<int,int,int> L);
 
+// ----------------------------------------------------------------------------- BITS
+/*
+* @brief (-1) to the number of the down spins (zero bits) of the state inside the mask - branch free
+* @param mask bit mask of the sites
+* @param state spin configuration with the up spins as the set bits
+*/
+inline double popcount_sign(u64 mask, u64 state) {
+	return 1.0 - 2.0 * double(std::popcount(mask & ~state) & 1);
+}
+
 // ----------------------------------------------------------------------------- MATRIX MULTIPLICATION
 /*
 * @brief Allows to calculate the matrix consisting of Column vector times row vector
@@ -506,6 +546,29 @@ inline bool valueEqualsPrec(T value, T eq, T tol) {
 	return std::abs(value - eq) < tol;
 }
 
+//? ------------------------------------------------------------------------------ STABLE FUNCTIONS ------------------------------------------------------------------------------
+/*
+* @brief logarithm of the hiperbolic cosine that does not overflow for large arguments,
+* uses log(cosh(x)) = x + log(1 + exp(-2x)) - log(2) with the sign of x chosen such that Re(x) >= 0
+* @param x argument (real or complex)
+*/
+template <typename T>
+inline T logCosh(T x) {
+	const T s = std::real(x) < 0 ? T(-x) : x;
+	return s + std::log(T(1.0) + std::exp(-2.0 * s)) - std::log(2.0);
+}
+
+/*
+* @brief elementwise stable logarithm of the hiperbolic cosine of a vector
+* @param x vector of arguments
+*/
+template <typename T>
+inline arma::Col<T> logCoshV(const arma::Col<T>& x) {
+	arma::Col<T> out = x;
+	out.transform([](T val) { return logCosh(val); });
+	return out;
+}
+
 
 /*
 *Changes a value to a string with a given precision